@@ -0,0 +1,542 @@
+// Headless batch evolution driver
+//
+// Runs Population generations as fast as the CPU allows, with no SDL/OpenGL.
+// Writes one line of stats per generation plus the best genotype found so far.
+// With -I the run is split into islands, one process each, which trade their
+// best genotypes over pipes every few generations.  Island i writes its output
+// to <dir>/island_i and the overall winner ends up in <dir>/best.dna.
+//
+
+//Basic engine stuff
+#include "common/sys_includes.h"
+#include "common/physics.h"
+#include "common/timer.h"
+#include "common/mapped_file.h"
+
+//STL
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <csignal>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+//Project files
+#include "project/population.h"
+#include "project/evaluator.h"
+#include "project/genotype_io.h"
+#include "project/checkpoint.h"
+#include "project/selection.h"
+#include "project/island.h"
+#include "project/batch_circuit.h"
+#include "project/telemetry.h"
+
+//Namespace aliasing
+using namespace std;
+using namespace Common;
+using namespace Game;
+
+//Run parameters
+int		num_creatures	= 150;
+int		num_high_scores	= 10;
+float	round_time		= 15000.;
+float	rest_time		= 5000.;
+float	time_step		= 0.01;
+int		num_generations	= 100;
+int		num_threads		= 1;
+int		num_lanes		= 1;
+long	seed			= 0;
+string	out_dir			= "data";
+bool	use_prescreen	= true;
+float	screen_keep		= 1.;
+bool	screen_approx	= false;
+float	approx_tolerance	= 1e-5;
+bool	cache_fitness	= true;
+TrialOptions	trials;
+bool	use_telemetry	= false;
+bool	profile_gates	= false;
+string	load_file;
+int		checkpoint_every	= 1;
+int		checkpoint_keep		= 3;
+bool	resume			= false;
+string	selection		= "roulette";
+float	crossover_rate	= 0.;
+float	graft_rate		= 0.;
+bool	prune_genes		= false;
+float	parsimony		= 0.;
+int		num_islands		= 1;
+int		migrate_every	= 5;
+int		num_migrants	= 2;
+
+struct option long_options[] =
+{
+	{ "resume",	no_argument,	NULL,	'R' },
+	{ "help",	no_argument,	NULL,	'h' },
+	{ NULL,		0,				NULL,	0 }
+};
+
+
+//Converts a genotype between the text and binary formats
+int convert(const char* in_file, const char* out_file)
+{
+	ifstream in(in_file, ios::in | ios::binary);
+	if(!in)
+	{
+		printf("Couldn't open %s\n", in_file);
+		return 1;
+	}
+	ofstream out(out_file, ios::out | ios::binary);
+	if(!out)
+	{
+		printf("Couldn't open %s\n", out_file);
+		return 1;
+	}
+	
+	try
+	{
+		if(is_binary(in))
+			binary_to_text(in, out);
+		else
+			text_to_binary(in, out);
+	}
+	catch(const char* err)
+	{
+		printf("Error converting %s: %s\n", in_file, err);
+		return 1;
+	}
+	catch(const string err)
+	{
+		printf("Error converting %s: %s\n", in_file, err.c_str());
+		return 1;
+	}
+	return 0;
+}
+
+
+void usage(const char* prog)
+{
+	printf(
+		"usage: %s [options]\n"
+		"  -n <count>    population size (%d)\n"
+		"  -b <count>    number of high scores to keep (%d)\n"
+		"  -r <ticks>    round time per test (%g)\n"
+		"  -s <ticks>    rest time before scoring starts (%g)\n"
+		"  -d <seconds>  physics time step (%g)\n"
+		"  -g <count>    run until this many generations have been bred (%d)\n"
+		"  -t <count>    number of worker threads (%d)\n"
+		"  -w <count>    trials each thread runs side by side in its scene, 1 to %d (%d)\n"
+		"  -x <seed>     random seed, defaults to the clock\n"
+		"  -o <dir>      output directory for stats.txt and best.dna (%s)\n"
+		"  -k <fraction> fraction of pre-screened genotypes given a full trial (%g)\n"
+		"  -p            disable the physics-free pre-screen\n"
+		"  -A            use fast approximate math in the pre-screen dry runs\n"
+		"  -a <error>    worst error against libm the fast math may have, -A falls\n"
+		"                back to libm beyond this (%g)\n"
+		"  -F            give every genotype a trial, even if it was scored before\n"
+		"  -u            build every creature from fresh actors instead of reusing them\n"
+		"  -O            run each tick's gates in dependency order, not body order\n"
+		"  -Q <passes>   extra passes each tick for feedback loops to settle (%d)\n"
+		"  -T <test>     fitness test: distance, height, swim or target (%s)\n"
+		"  -G <ticks>    stop a trial after this many ticks without progress, 0 never (%d)\n"
+		"  -E <gain>     smallest gain in fitness which counts as progress (%g)\n"
+		"  -H            stop trials which can no longer make the high scores\n"
+		"  -L            log timings of every trial and generation to trials.csv\n"
+		"                and generations.csv in <dir>\n"
+		"  -P            also count and time every gate by type, and log circuit\n"
+		"                sizes and wire fan in/out, to circuits.csv; implies -L\n"
+		"  -S <policy>   parent selection: roulette, alias, tournament or rank (%s)\n"
+		"  -X <fraction> fraction of children bred by crossover of two parents (%g)\n"
+		"  -J <fraction> fraction of children bred by grafting one parent onto another (%g)\n"
+		"  -D            strip every child of the gates and wires which can't move it\n"
+		"  -W <weight>   parsimony, parents are picked on score / (1 + weight * size) (%g)\n"
+		"  -I <count>    number of islands, each runs in its own process (%d)\n"
+		"  -M <count>    islands trade genotypes every this many generations (%d)\n"
+		"  -m <count>    number of genotypes each island sends its neighbour (%d)\n"
+		"  -l <file>     start from a saved population instead of a random one\n"
+		"  -C <count>    checkpoint every this many generations, 0 to disable (%d)\n"
+		"  -K <count>    number of checkpoints to keep (%d)\n"
+		"  -R, --resume  continue from the latest checkpoint in <dir>/checkpoints\n"
+		"\n"
+		"   or: %s -c <in> <out>\n"
+		"  converts a genotype between the text and binary formats\n",
+		prog,
+		num_creatures, num_high_scores, round_time, rest_time, time_step,
+		num_generations, num_threads, MAX_LANES, num_lanes, out_dir.c_str(), screen_keep,
+		approx_tolerance,
+		settle_passes, trials.test.c_str(), trials.stagnation, trials.min_gain,
+		selection.c_str(), crossover_rate, graft_rate, parsimony, num_islands, migrate_every, num_migrants,
+		checkpoint_every, checkpoint_keep,
+		prog);
+}
+
+//Runs one population to the end.  With a channel the population is one
+//island of a ring and trades its best genotypes with its neighbours.
+int run_island(int island, const string& dir, MigrationChannel* channel)
+{
+	string tag;
+	if(channel != NULL)
+	{
+		char buf[32];
+		snprintf(buf, sizeof(buf), "Island %d: ", island);
+		tag = buf;
+	}
+	
+	//Every island draws from its own stream of the same seed
+	Random island_rng(seed, island);
+	
+	//Initialize physics
+	phys_init();
+	
+	string path = load_file;
+	string checkpoint_dir = dir + "/checkpoints";
+	if(resume)
+	{
+		path = Checkpointer::latest(checkpoint_dir);
+		if(path.size() == 0)
+		{
+			printf("No checkpoint found in %s\n", checkpoint_dir.c_str());
+			exit(1);
+		}
+	}
+	if(checkpoint_every > 0)
+		mkdir(checkpoint_dir.c_str(), 0755);
+	
+	//A resumed run keeps adding to the old stats
+	string stats_file = dir + "/stats.txt";
+	ofstream stats(stats_file.c_str(), resume ? ios::app : ios::out);
+	if(!stats)
+	{
+		printf("Couldn't open %s\n", stats_file.c_str());
+		exit(1);
+	}
+	if(!resume)
+		stats << "# generation min mean max best" << endl;
+	
+	Population population(num_creatures, num_high_scores, NULL, island_rng);
+	population.verbose		= false;
+	population.best_file	= dir + "/best.dna";
+	population.stats_log	= &stats;
+	population.prescreen	= use_prescreen;
+	population.screen_keep	= screen_keep;
+	population.screen_opts.approx = screen_approx;
+	population.cache_fitness	= cache_fitness;
+	population.set_selector(createSelector(selection));
+	population.crossover_rate	= crossover_rate;
+	population.graft_rate		= graft_rate;
+	population.prune_genes		= prune_genes;
+	population.parsimony		= parsimony;
+	population.screen_generation();
+	
+	if(path.size() > 0)
+	{
+		MappedFile file;
+		if(!file.open(path.c_str()))
+		{
+			printf("Couldn't open %s\n", path.c_str());
+			exit(1);
+		}
+		
+		try
+		{
+			population.load(file.data, file.size);
+		}
+		catch(const char* err)
+		{
+			printf("Error loading %s: %s\n", path.c_str(), err);
+			exit(1);
+		}
+		
+		//A checkpoint brings its own random state, a plain population
+		//file keeps the seed from the command line
+		if(resume)
+			printf("%sResuming from %s at generation %d\n", tag.c_str(),
+				path.c_str(), population.generation);
+		else
+			population.rng = island_rng;
+	}
+	
+	ParallelEvaluator evaluator(num_threads, round_time, rest_time, time_step, trials, num_lanes);
+	
+	Telemetry* telemetry = NULL;
+	if(use_telemetry)
+	{
+		telemetry = new Telemetry(dir, evaluator.num_workers(), resume, profile_gates);
+		if(!telemetry->ok())
+			printf("%sCouldn't open the telemetry files in %s\n", tag.c_str(), dir.c_str());
+		population.telemetry = telemetry;
+		evaluator.set_profiling(profile_gates);
+	}
+	
+	printf("%sEvolving %d creatures up to generation %d on %d threads, seed = %ld\n",
+		tag.c_str(), num_creatures, num_generations, evaluator.num_workers(), seed);
+	
+	Checkpointer* checkpoints = NULL;
+	if(checkpoint_every > 0)
+		checkpoints = new Checkpointer(checkpoint_dir, checkpoint_keep);
+	
+	while(population.generation < num_generations)
+	{
+		double t0 = wall_time();
+		int stops = evaluator.early_stops();
+		population.run_generation(evaluator);
+		double dt = wall_time() - t0;
+		
+		printf("%sGeneration %d: best = %g, %d stopped early (%.2fs)\n",
+			tag.c_str(), population.generation,
+			population.best_species[population.best_species.size()-1].first,
+			evaluator.early_stops() - stops, dt);
+		
+		//Messages queue up in the pipes, so an island which is ahead just
+		//waits for its neighbour.  Once the neighbour is done we carry on alone.
+		if(channel != NULL && population.generation % migrate_every == 0)
+		{
+			Migrants out, in;
+			population.emigrants(num_migrants, out);
+			channel->send(out);
+			if(channel->receive(in))
+				population.immigrate(in);
+		}
+		
+		if(checkpoints != NULL && population.generation % checkpoint_every == 0)
+			checkpoints->push(population);
+	}
+	
+	//Waits for the last checkpoint
+	delete checkpoints;
+	
+	if(telemetry != NULL)
+	{
+		if(telemetry->dropped() > 0)
+			printf("%sTelemetry dropped %d records\n", tag.c_str(), telemetry->dropped());
+		population.telemetry = NULL;
+		delete telemetry;
+	}
+	
+	//Save the final population
+	string pop_file = dir + "/population.pop";
+	ofstream pop(pop_file.c_str(), ios::out | ios::binary);
+	population.save(pop);
+	
+	return 0;
+}
+
+//Forks one process per island, each with its own physics SDK and random
+//state, connected in a ring of pipes
+int run_islands()
+{
+	//A finished island closes its pipes, writing to them must not kill us
+	signal(SIGPIPE, SIG_IGN);
+	
+	vector<int> fds(2 * num_islands);
+	for(int i=0; i<num_islands; i++)
+	{
+		if(pipe(&fds[2*i]) != 0)
+		{
+			printf("Couldn't create pipes\n");
+			exit(1);
+		}
+	}
+	
+	vector<pid_t> children;
+	for(int i=0; i<num_islands; i++)
+	{
+		char buf[32];
+		snprintf(buf, sizeof(buf), "/island_%d", i);
+		string dir = out_dir + buf;
+		mkdir(dir.c_str(), 0755);
+		
+		fflush(stdout);
+		pid_t pid = fork();
+		if(pid < 0)
+		{
+			printf("Couldn't start island %d\n", i);
+			exit(1);
+		}
+		if(pid == 0)
+		{
+			//Island i reads what island i-1 wrote
+			int in_fd	= fds[2 * ((i + num_islands - 1) % num_islands)];
+			int out_fd	= fds[2*i + 1];
+			for(int j=0; j<(int)fds.size(); j++)
+			{
+				if(fds[j] != in_fd && fds[j] != out_fd)
+					close(fds[j]);
+			}
+			
+			setvbuf(stdout, NULL, _IOLBF, 0);
+			int res;
+			{
+				PipeChannel channel(in_fd, out_fd);
+				res = run_island(i, dir, &channel);
+			}
+			exit(res);
+		}
+		children.push_back(pid);
+	}
+	
+	for(int i=0; i<(int)fds.size(); i++)
+		close(fds[i]);
+	
+	int failed = 0;
+	for(int i=0; i<(int)children.size(); i++)
+	{
+		int status;
+		waitpid(children[i], &status, 0);
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		{
+			printf("Island %d failed\n", i);
+			failed++;
+		}
+	}
+	
+	//Collect the overall winner from the final populations
+	pair<float,Genotype> best(-1., Genotype());
+	int best_island = -1;
+	for(int i=0; i<num_islands; i++)
+	{
+		char buf[64];
+		snprintf(buf, sizeof(buf), "/island_%d/population.pop", i);
+		string path = out_dir + buf;
+		
+		MappedFile file;
+		if(!file.open(path.c_str()))
+			continue;
+		
+		try
+		{
+			PopulationState state;
+			state.load(file.data, file.size);
+			const pair<float,Genotype>& b = state.best_species[state.best_species.size()-1];
+			if(b.first > best.first)
+			{
+				best = b;
+				best_island = i;
+			}
+		}
+		catch(const char* err)
+		{
+			printf("Error loading %s: %s\n", path.c_str(), err);
+		}
+	}
+	
+	if(best_island >= 0)
+	{
+		string best_file = out_dir + "/best.dna";
+		ofstream out(best_file.c_str());
+		best.second.save(out);
+		printf("Best overall: %g from island %d\n", best.first, best_island);
+	}
+	
+	return failed > 0 ? 1 : 0;
+}
+
+//Program start point
+int main(int argc, char** argv)
+{
+	seed = time(NULL);
+
+	int c;
+	while((c = getopt_long(argc, argv, "n:b:r:s:d:g:t:w:x:o:k:pAa:FuOQ:T:G:E:HLPS:X:J:DW:I:M:m:l:C:K:Rc:h",
+			long_options, NULL)) != -1)
+	{
+		switch(c)
+		{
+			case 'n': num_creatures = atoi(optarg); break;
+			case 'b': num_high_scores = atoi(optarg); break;
+			case 'r': round_time = atof(optarg); break;
+			case 's': rest_time = atof(optarg); break;
+			case 'd': time_step = atof(optarg); break;
+			case 'g': num_generations = atoi(optarg); break;
+			case 't': num_threads = atoi(optarg); break;
+			case 'w': num_lanes = atoi(optarg); break;
+			case 'x': seed = atol(optarg); break;
+			case 'o': out_dir = optarg; break;
+			case 'k': screen_keep = atof(optarg); break;
+			case 'p': use_prescreen = false; break;
+			case 'A': screen_approx = true; break;
+			case 'a': approx_tolerance = atof(optarg); break;
+			case 'F': cache_fitness = false; break;
+			case 'u': pool_objects = false; break;
+			case 'O': schedule_circuits = true; break;
+			case 'Q': settle_passes = atoi(optarg); break;
+			case 'T': trials.test = optarg; break;
+			case 'G': trials.stagnation = atoi(optarg); break;
+			case 'E': trials.min_gain = atof(optarg); break;
+			case 'H': trials.hopeless = true; break;
+			case 'L': use_telemetry = true; break;
+			case 'P': use_telemetry = profile_gates = true; break;
+			case 'S': selection = optarg; break;
+			case 'X': crossover_rate = atof(optarg); break;
+			case 'J': graft_rate = atof(optarg); break;
+			case 'D': prune_genes = true; break;
+			case 'W': parsimony = atof(optarg); break;
+			case 'I': num_islands = atoi(optarg); break;
+			case 'M': migrate_every = atoi(optarg); break;
+			case 'm': num_migrants = atoi(optarg); break;
+			case 'l': load_file = optarg; break;
+			case 'C': checkpoint_every = atoi(optarg); break;
+			case 'K': checkpoint_keep = atoi(optarg); break;
+			case 'R': resume = true; break;
+			
+			case 'c':
+				if(optind >= argc)
+				{
+					usage(argv[0]);
+					exit(1);
+				}
+				return convert(optarg, argv[optind]);
+			
+			default:
+				usage(argv[0]);
+				exit(1);
+		}
+	}
+	
+	//The dry runs only rank genotypes, but a broken kernel would still skew them
+	MathError worst;
+	if(screen_approx && !fast_math_ok(approx_tolerance, &worst))
+	{
+		printf("Fast math %s is off by %g at %g, more than %g, using libm\n",
+			worst.name, worst.worst, worst.at, approx_tolerance);
+		screen_approx = false;
+	}
+	
+	if(num_creatures < 1 || num_high_scores < 1 || num_threads < 1 ||
+	   num_lanes < 1 || num_lanes > MAX_LANES || settle_passes < 0 ||
+	   checkpoint_every < 0 || checkpoint_keep < 1 || trials.stagnation < 0 ||
+	   num_islands < 1 || migrate_every < 1 || num_migrants < 0 ||
+	   crossover_rate < 0. || graft_rate < 0. || crossover_rate + graft_rate > 1. || parsimony < 0.)
+	{
+		usage(argv[0]);
+		exit(1);
+	}
+	
+	Selector* selector = createSelector(selection);
+	if(selector == NULL)
+	{
+		printf("Unknown selection policy: %s\n", selection.c_str());
+		usage(argv[0]);
+		exit(1);
+	}
+	delete selector;
+	
+	FitnessTest* test = createFitnessTest(trials, round_time, rest_time);
+	if(test == NULL)
+	{
+		printf("Unknown fitness test: %s\n", trials.test.c_str());
+		usage(argv[0]);
+		exit(1);
+	}
+	delete test;
+	
+	if(num_islands == 1)
+		return run_island(0, out_dir, NULL);
+	return run_islands();
+}
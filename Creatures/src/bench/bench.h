@@ -0,0 +1,44 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <string>
+
+namespace Bench
+{
+	//A benchmark registers itself by declaring a static Benchmark object,
+	//the driver in main.cpp then runs it by name
+	struct Benchmark
+	{
+		Benchmark(const char* name, const char* description, void (*run)());
+		
+		const char*	name;
+		const char*	description;
+		void		(*run)();
+	};
+	
+	//Times f() repeatedly until at least min_time seconds have passed,
+	//returns seconds per call
+	double time_per_call(void (*f)(void*), void* data, double min_time = 0.2);
+	
+	//Time and heap allocations (operator new calls) per call
+	struct Cost
+	{
+		double	seconds;
+		double	allocs;
+	};
+	
+	//Same as time_per_call, also counts allocations
+	Cost cost_per_call(void (*f)(void*), void* data, double min_time = 0.2);
+	
+	//Number of operator new calls since the start
+	long allocations();
+	
+	//Starts the physics SDK the first time it is called, for benchmarks
+	//which need a scene
+	void init_physics();
+	
+	//Keeps the optimizer from throwing away a result
+	void consume(int x);
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <utility>
+
+#include "common/sys_includes.h"
+
+#include "project/genotype.h"
+#include "project/mutation.h"
+#include "project/population.h"
+
+#include "bench/bench.h"
+
+using namespace std;
+using namespace Common;
+using namespace Game;
+using namespace Bench;
+
+namespace
+{
+
+//The breeding half of Population::next_round: pick parents, copy and mutate.
+//The parents stay as they are, so every call does the same amount of work,
+//apart from the fresh random key each round.
+void breed(void* data)
+{
+	Population* p = (Population*)data;
+	vector< pair<float,Genotype> > next;
+	p->breed(next);
+	consume(next.size());
+}
+
+void run()
+{
+	printf("%-10s %16s %14s %14s\n", "species", "generation (ms)", "ns/child", "allocs/child");
+
+	for(int n=10; n<=10000; n*=10)
+	{
+		//Built with one creature, so the constructor doesn't screen a whole
+		//generation the benchmark never uses
+		Population p(1, 1, NULL, Random(1));
+		p.verbose = false;
+		p.prescreen = false;
+		
+		Random rng(1);
+		p.species.clear();
+		for(int i=0; i<n; i++)
+		{
+			//Mostly small scores with a long tail, like a real generation
+			float score = 1e-4 + pow(rng.uniform(), 4.) * 100.;
+			p.species.push_back(make_pair(score, randomCreature(rng)));
+		}
+
+		Cost t = cost_per_call(breed, &p, 0.5);
+		printf("%-10d %16.3f %14.0f %14.1f\n",
+			n, t.seconds * 1e3, t.seconds / n * 1e9, t.allocs / n);
+	}
+}
+
+Benchmark bench("breed", "selection, copying and mutation of one generation against population size", run);
+
+};
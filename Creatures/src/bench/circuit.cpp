@@ -0,0 +1,166 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <map>
+#include <vector>
+
+#include "common/arena.h"
+
+#include "project/circuit.h"
+#include "project/batch_circuit.h"
+
+#include "bench/bench.h"
+
+using namespace std;
+using namespace Common;
+using namespace Game;
+using namespace Bench;
+
+namespace
+{
+
+Random rng(1);
+
+//A set of sibling circuits, same wiring, different gate parameters
+struct Case
+{
+	Arena						arena;
+	vector<CompiledCircuit*>	circuits;
+	BatchCircuit*				batch;
+	BatchCircuit*				approx;
+
+	~Case()
+	{
+		delete batch;
+		delete approx;
+		for(int i=0; i<(int)circuits.size(); i++)
+			delete circuits[i];
+	}
+};
+
+//Random control network of num_gates gates, each with two inputs and one
+//output drawn from num_wires wires
+void build(Case& c, int num_gates, int num_wires)
+{
+	vector<int> types;
+	vector< vector<float> > params;
+	vector<int> links;
+	for(int i=0; i<num_gates; i++)
+	{
+		types.push_back(randomGateId(rng));
+		params.push_back(getFactory(types[i])->generateParams(rng));
+		for(int j=0; j<3; j++)
+			links.push_back(rng.below(num_wires));
+	}
+
+	for(int l=0; l<BATCH_WIDTH; l++)
+	{
+		vector<Wire*> wires;
+		for(int i=0; i<num_wires; i++)
+			wires.push_back(new (c.arena) Wire());
+
+		CompiledCircuit* circuit = new CompiledCircuit();
+		map<Wire*, int> wire_ids;
+		for(int i=0; i<num_gates; i++)
+		{
+			GateFactory* f = getFactory(types[i]);
+			vector<float> p = params[i];
+			if(l > 0)
+				f->perturbParams(p, rng);
+
+			Gate* g = f->createGate(p, c.arena);
+			g->inputs.push_back(wires[links[3*i]]);
+			g->inputs.push_back(wires[links[3*i+1]]);
+			g->outputs.push_back(wires[links[3*i+2]]);
+			circuit->append(g, wire_ids);
+		}
+		c.circuits.push_back(circuit);
+	}
+
+	c.batch = new BatchCircuit(c.circuits);
+	c.approx = new BatchCircuit(c.circuits, true);
+}
+
+void scalar_tick(void* data)
+{
+	Case* c = (Case*)data;
+	for(int i=0; i<(int)c->circuits.size(); i++)
+		c->circuits[i]->update();
+	consume((int)c->circuits[0]->values[0]);
+}
+
+void batch_tick(void* data)
+{
+	Case* c = (Case*)data;
+	c->batch->update();
+	c->batch->store();
+	consume((int)c->circuits[0]->values[0]);
+}
+
+void approx_tick(void* data)
+{
+	Case* c = (Case*)data;
+	c->approx->update();
+	c->approx->store();
+	consume((int)c->circuits[0]->values[0]);
+}
+
+//Same number of ticks on each side, then compares the wire values
+bool same_results(int num_gates, int num_wires, int ticks)
+{
+	Random start = rng;
+	Case a, b;
+	build(a, num_gates, num_wires);
+	rng = start;
+	build(b, num_gates, num_wires);
+
+	for(int t=0; t<ticks; t++)
+	{
+		for(int i=0; i<BATCH_WIDTH; i++)
+			a.circuits[i]->update();
+		b.batch->update();
+	}
+	b.batch->store();
+
+	for(int i=0; i<BATCH_WIDTH; i++)
+	{
+		const vector<float>& x = a.circuits[i]->values;
+		const vector<float>& y = b.circuits[i]->values;
+		if(x.size() != y.size() || (x.size() > 0 && memcmp(&x[0], &y[0], x.size() * sizeof(float)) != 0))
+			return false;
+	}
+	return true;
+}
+
+void run()
+{
+	vector<MathError> errors;
+	check_fast_math(errors);
+	printf("%-6s %12s %14s\n", "kernel", "worst error", "at");
+	for(int i=0; i<(int)errors.size(); i++)
+		printf("%-6s %12.3g %14.6g\n", errors[i].name, errors[i].worst, errors[i].at);
+	printf("\n");
+
+	printf("%d lanes, ticking every lane once\n", BATCH_WIDTH);
+	printf("%-8s %8s %12s %12s %12s %8s\n",
+		"gates", "exact", "scalar (us)", "batch (us)", "approx (us)", "speedup");
+
+	for(int n=16; n<=1024; n*=4)
+	{
+		Case c;
+		build(c, n, n);
+
+		double t_scalar	= time_per_call(scalar_tick, &c);
+		double t_batch	= time_per_call(batch_tick, &c);
+		double t_approx	= time_per_call(approx_tick, &c);
+
+		printf("%-8d %8s %12.2f %12.2f %12.2f %8.2f\n",
+			n, same_results(n, n, 100) ? "yes" : "NO",
+			t_scalar * 1e6, t_batch * 1e6, t_approx * 1e6, t_scalar / t_approx);
+	}
+}
+
+Benchmark bench("circuit", "compiled circuits one by one against BatchCircuit", run);
+
+};
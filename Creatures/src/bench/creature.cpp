@@ -0,0 +1,94 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "common/sys_includes.h"
+#include "common/physics.h"
+
+#include "project/genotype.h"
+#include "project/mutation.h"
+#include "project/creature.h"
+
+#include "bench/bench.h"
+
+using namespace std;
+using namespace Common;
+using namespace Game;
+using namespace Bench;
+
+namespace
+{
+
+Random rng(1);
+
+void compiled_tick(void* data)
+{
+	Creature* c = (Creature*)data;
+	c->update();
+	consume(c->body.size());
+}
+
+//What Creature::update() does without a compiled circuit
+void gate_tick(void* data)
+{
+	Creature* c = (Creature*)data;
+	for(int i=0; i<(int)c->body.size(); i++)
+		c->body[i]->update();
+	consume(c->body.size());
+}
+
+int count_gates(const Creature* c)
+{
+	int n = 0;
+	for(int i=0; i<(int)c->body.size(); i++)
+	{
+		BodyPart* p = c->body[i];
+		n += p->sensors.size() + p->controls.size() + p->effectors.size();
+	}
+	return n;
+}
+
+int count_wires(const Creature* c)
+{
+	int n = 0;
+	for(int i=0; i<(int)c->body.size(); i++)
+		n += c->body[i]->wires.size();
+	return n;
+}
+
+//One control tick of a built creature, the scene is never stepped
+void run()
+{
+	init_physics();
+
+	printf("%-8s %8s %8s %16s %16s %14s\n",
+		"parts", "gates", "wires", "gates (ns/tick)", "compiled (ns)", "allocs/tick");
+
+	for(int g=4; g<=256; g*=4)
+	{
+		//Not every genotype builds, keep drawing until one does
+		Creature* c = NULL;
+		for(int tries=0; c == NULL && tries<100; tries++)
+		{
+			NxMat34 pose;
+			pose.id();
+			c = randomCreature(rng, 5, 4, g, 5*g).createCreature(scene, pose);
+		}
+		if(c == NULL)
+		{
+			printf("%-8s %8d  no genotype built\n", "-", g);
+			continue;
+		}
+
+		Cost slow = cost_per_call(gate_tick, c);
+		Cost fast = cost_per_call(compiled_tick, c);
+		printf("%-8d %8d %8d %16.0f %16.0f %14.1f\n",
+			(int)c->body.size(), count_gates(c), count_wires(c),
+			slow.seconds * 1e9, fast.seconds * 1e9, fast.allocs);
+		delete c;
+	}
+}
+
+Benchmark bench("creature", "control tick of built creatures, gate objects against the compiled circuit", run);
+
+};
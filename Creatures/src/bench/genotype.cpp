@@ -0,0 +1,160 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <vector>
+
+#include "common/sys_includes.h"
+#include "common/physics.h"
+
+#include "project/genotype.h"
+#include "project/genotype_io.h"
+#include "project/mutation.h"
+#include "project/creature.h"
+
+#include "bench/bench.h"
+
+using namespace std;
+using namespace Common;
+using namespace Game;
+using namespace Bench;
+
+namespace
+{
+
+const int POOL_SIZE = 64;
+
+//Random genotypes and their encodings, each operation walks through them in turn
+struct Pool
+{
+	vector<Genotype>	genes;
+	vector<string>		text;
+	vector<string>		binary;
+	Random				rng;
+	int					next;
+
+	Pool() : rng(1), next(0)
+	{
+		for(int i=0; i<POOL_SIZE; i++)
+		{
+			genes.push_back(randomCreature(rng));
+
+			ostringstream t, b;
+			genes[i].save(t);
+			save_binary(genes[i], b);
+			text.push_back(t.str());
+			binary.push_back(b.str());
+		}
+	}
+
+	int pick()
+	{
+		next = (next + 1) % POOL_SIZE;
+		return next;
+	}
+};
+
+void copy_op(void* data)
+{
+	Pool* p = (Pool*)data;
+	Genotype g = p->genes[p->pick()];
+	consume(g.nodes.size());
+}
+
+void mutate_op(void* data)
+{
+	Pool* p = (Pool*)data;
+	Genotype g = p->genes[p->pick()];
+	mutate(g, p->rng);
+	consume(g.nodes.size());
+}
+
+void normalize_op(void* data)
+{
+	Pool* p = (Pool*)data;
+	Genotype g = p->genes[p->pick()];
+	g.normalize();
+	consume(g.nodes.size());
+}
+
+void save_text_op(void* data)
+{
+	Pool* p = (Pool*)data;
+	ostringstream os;
+	p->genes[p->pick()].save(os);
+	consume(os.str().size());
+}
+
+void load_text_op(void* data)
+{
+	Pool* p = (Pool*)data;
+	istringstream is(p->text[p->pick()]);
+	consume(Genotype::load(is).nodes.size());
+}
+
+void save_binary_op(void* data)
+{
+	Pool* p = (Pool*)data;
+	ostringstream os;
+	save_binary(p->genes[p->pick()], os);
+	consume(os.str().size());
+}
+
+void load_binary_op(void* data)
+{
+	Pool* p = (Pool*)data;
+	const string& s = p->binary[p->pick()];
+	consume(load_binary(s.data(), s.size()).nodes.size());
+}
+
+void build_op(void* data)
+{
+	Pool* p = (Pool*)data;
+	NxMat34 pose;
+	pose.id();
+	Creature* c = p->genes[p->pick()].createCreature(scene, pose);
+	consume(c != NULL);
+	delete c;
+}
+
+void run()
+{
+	init_physics();
+
+	struct { const char* name; void (*f)(void*); } ops[] =
+	{
+		{ "copy",			copy_op },
+		{ "mutate",			mutate_op },
+		{ "normalize",		normalize_op },
+		{ "save text",		save_text_op },
+		{ "load text",		load_text_op },
+		{ "save binary",	save_binary_op },
+		{ "load binary",	load_binary_op },
+		{ "build",			build_op },
+	};
+	const int num_ops = sizeof(ops) / sizeof(ops[0]);
+
+	int nodes = 0, gates = 0;
+	size_t text = 0;
+	Pool pool;
+	for(int i=0; i<POOL_SIZE; i++)
+	{
+		nodes += pool.genes[i].nodes.size();
+		for(int j=0; j<(int)pool.genes[i].nodes.size(); j++)
+			gates += pool.genes[i].nodes[j].gates.size();
+		text += pool.text[i].size();
+	}
+	printf("%d random genotypes, %.1f nodes, %.1f gates, %.0f bytes of text on average\n",
+		POOL_SIZE, (double)nodes / POOL_SIZE, (double)gates / POOL_SIZE, (double)text / POOL_SIZE);
+	printf("%-12s %12s %12s\n", "operation", "ns/op", "allocs/op");
+
+	for(int i=0; i<num_ops; i++)
+	{
+		Cost c = cost_per_call(ops[i].f, &pool);
+		printf("%-12s %12.0f %12.1f\n", ops[i].name, c.seconds * 1e9, c.allocs);
+	}
+}
+
+Benchmark bench("genotype", "copying, mutating, saving, loading and building genotypes", run);
+
+};
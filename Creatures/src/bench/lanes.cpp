@@ -0,0 +1,92 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <utility>
+
+#include "common/sys_includes.h"
+#include "common/physics.h"
+
+#include "project/genotype.h"
+#include "project/mutation.h"
+#include "project/evaluator.h"
+
+#include "bench/bench.h"
+
+using namespace std;
+using namespace Common;
+using namespace Game;
+using namespace Bench;
+
+namespace
+{
+
+const int NUM_SPECIES	= 64;
+const float ROUND_TIME	= 1000.;
+const float REST_TIME	= 200.;
+const float TIME_STEP	= 0.01;
+
+struct Case
+{
+	ParallelEvaluator*				evaluator;
+	vector< pair<float,Genotype> >	species;
+};
+
+void evaluate(void* data)
+{
+	Case* c = (Case*)data;
+	c->evaluator->evaluate(c->species);
+	consume(c->species.size());
+}
+
+//One worker thread scoring a generation, with the trials run one after
+//another and side by side in the same scene.  The lanes don't touch, so
+//the scores should match.
+void run()
+{
+	init_physics();
+
+	Random rng(1);
+	vector< pair<float,Genotype> > species;
+	for(int i=0; i<NUM_SPECIES; i++)
+		species.push_back(make_pair(0.f, randomCreature(rng)));
+
+	printf("%d trials of %g ticks on one thread\n", NUM_SPECIES, ROUND_TIME);
+	printf("%-8s %16s %14s %10s %16s\n",
+		"lanes", "generation (ms)", "ms/trial", "speedup", "fitness drift");
+
+	int lanes[] = { 1, 16 };
+	double base_time = 0.;
+	vector<float> base_fitness;
+	for(int i=0; i<2; i++)
+	{
+		Case c;
+		c.evaluator = new ParallelEvaluator(1, ROUND_TIME, REST_TIME, TIME_STEP, TrialOptions(), lanes[i]);
+		c.species = species;
+
+		//A generation takes long enough to time on its own
+		Cost t = cost_per_call(evaluate, &c, 1e-6);
+
+		//Largest difference to the scores of the single lane run
+		double drift = 0.;
+		if(i == 0)
+		{
+			base_time = t.seconds;
+			for(int j=0; j<NUM_SPECIES; j++)
+				base_fitness.push_back(c.species[j].first);
+		}
+		else for(int j=0; j<NUM_SPECIES; j++)
+		{
+			drift = max(drift, fabs((double)c.species[j].first - base_fitness[j]));
+		}
+
+		printf("%-8d %16.1f %14.2f %10.2f %16g\n",
+			lanes[i], t.seconds * 1e3, t.seconds / NUM_SPECIES * 1e3,
+			base_time / t.seconds, drift);
+		delete c.evaluator;
+	}
+}
+
+Benchmark bench("lanes", "a generation of trials run one at a time against 16 side by side in one scene", run);
+
+};
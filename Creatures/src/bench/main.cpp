@@ -0,0 +1,158 @@
+// Micro benchmarks
+//
+// Each benchmark prints a small table on stdout.  Run with no arguments to
+// get all of them, or name the ones you want.  Every benchmark seeds its own
+// Random, so two runs do the same work and their numbers can be compared.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "common/sys_includes.h"
+#include "common/timer.h"
+#include "common/physics.h"
+
+#include "bench/bench.h"
+
+using namespace std;
+using namespace Common;
+
+//Counts every allocation which goes through operator new
+static volatile long num_allocations = 0;
+
+void* operator new(size_t size) throw(std::bad_alloc)
+{
+	__sync_fetch_and_add(&num_allocations, 1);
+	void* p = malloc(size > 0 ? size : 1);
+	if(p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	free(p);
+}
+
+namespace Bench
+{
+
+static vector<Benchmark*>& registry()
+{
+	static vector<Benchmark*> benchmarks;
+	return benchmarks;
+}
+
+Benchmark::Benchmark(const char* name_, const char* description_, void (*run_)()) :
+	name(name_),
+	description(description_),
+	run(run_)
+{
+	registry().push_back(this);
+}
+
+double time_per_call(void (*f)(void*), void* data, double min_time)
+{
+	int calls = 0;
+	double t0 = wall_time(), t = t0;
+	for(int n=1; t - t0 < min_time; n *= 2)
+	{
+		for(int i=0; i<n; i++)
+			f(data);
+		calls += n;
+		t = wall_time();
+	}
+	return (t - t0) / calls;
+}
+
+Cost cost_per_call(void (*f)(void*), void* data, double min_time)
+{
+	int calls = 0;
+	long a0 = allocations();
+	double t0 = wall_time(), t = t0;
+	for(int n=1; t - t0 < min_time; n *= 2)
+	{
+		for(int i=0; i<n; i++)
+			f(data);
+		calls += n;
+		t = wall_time();
+	}
+	
+	Cost c;
+	c.seconds	= (t - t0) / calls;
+	c.allocs	= (double)(allocations() - a0) / calls;
+	return c;
+}
+
+long allocations()
+{
+	return num_allocations;
+}
+
+void init_physics()
+{
+	static bool started = false;
+	if(!started)
+	{
+		phys_init();
+		started = true;
+	}
+}
+
+volatile int sink;
+
+void consume(int x)
+{
+	sink += x;
+}
+
+};
+
+using namespace Bench;
+
+int main(int argc, char** argv)
+{
+	vector<Benchmark*>& benchmarks = registry();
+	
+	if(argc > 1 && strcmp(argv[1], "-l") == 0)
+	{
+		for(int i=0; i<(int)benchmarks.size(); i++)
+			printf("%-16s %s\n", benchmarks[i]->name, benchmarks[i]->description);
+		return 0;
+	}
+	
+	int ran = 0;
+	for(int i=0; i<(int)benchmarks.size(); i++)
+	{
+		bool wanted = argc <= 1;
+		for(int j=1; j<argc; j++)
+			wanted |= strcmp(argv[j], benchmarks[i]->name) == 0;
+		if(!wanted)
+			continue;
+		
+		printf("== %s: %s\n", benchmarks[i]->name, benchmarks[i]->description);
+		benchmarks[i]->run();
+		printf("\n");
+		ran++;
+	}
+	
+	if(ran == 0)
+	{
+		printf("usage: %s [-l] [benchmark ...]\n", argv[0]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,99 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+#include "project/selection.h"
+
+#include "bench/bench.h"
+
+using namespace std;
+using namespace Game;
+using namespace Bench;
+
+namespace
+{
+
+Common::Random rng(1);
+
+struct Case
+{
+	Selector*		selector;
+	vector<float>	fitness;
+	float			total;
+};
+
+//The selection loop Population::next_round used to run
+int linear_select(const Case& c)
+{
+	float r = rng.uniform() * c.total;
+	for(int j=0; j<(int)c.fitness.size(); j++)
+	{
+		r -= c.fitness[j];
+		if(r <= 0.)
+			return j;
+	}
+	return c.fitness.size() - 1;
+}
+
+void linear_pick(void* data)
+{
+	consume(linear_select(*(Case*)data));
+}
+
+void pick(void* data)
+{
+	consume(((Case*)data)->selector->select(rng));
+}
+
+void prepare(void* data)
+{
+	Case* c = (Case*)data;
+	c->selector->prepare(c->fitness);
+}
+
+void run()
+{
+	const char* policies[] = { "linear", "roulette", "alias", "tournament", "rank" };
+	const int num_policies = sizeof(policies) / sizeof(policies[0]);
+	
+	printf("%-12s %10s %14s %12s %16s\n",
+		"policy", "species", "prepare (ms)", "pick (ns)", "generation (ms)");
+	
+	for(int n=100; n<=1000000; n*=10)
+	{
+		Case c;
+		c.fitness.resize(n);
+		c.total = 0.;
+		for(int i=0; i<n; i++)
+		{
+			//Mostly small scores with a long tail, like a real generation
+			c.fitness[i] = 1e-4 + pow(rng.uniform(), 4.) * 100.;
+			c.total += c.fitness[i];
+		}
+		
+		for(int p=0; p<num_policies; p++)
+		{
+			double t_prep = 0., t_pick;
+			c.selector = NULL;
+			if(p == 0)
+			{
+				t_pick = time_per_call(linear_pick, &c);
+			}
+			else
+			{
+				c.selector = createSelector(policies[p]);
+				t_prep = time_per_call(prepare, &c);
+				t_pick = time_per_call(pick, &c);
+			}
+			
+			printf("%-12s %10d %14.3f %12.1f %16.3f\n",
+				policies[p], n, t_prep * 1e3, t_pick * 1e9, (t_prep + n * t_pick) * 1e3);
+			delete c.selector;
+		}
+	}
+}
+
+Benchmark bench("selection", "parent selection cost against population size", run);
+
+};
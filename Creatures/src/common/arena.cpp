@@ -0,0 +1,62 @@
+#include <cstdlib>
+#include <new>
+
+#include "common/arena.h"
+
+namespace Common
+{
+	Arena::Arena(size_t block_size_) :
+		block_size(block_size_),
+		current(-1),
+		ptr(NULL),
+		left(0),
+		in_use(0)
+	{
+	}
+
+	Arena::~Arena()
+	{
+		reset();
+		for(int i=0; i<(int)blocks.size(); i++)
+			free(blocks[i].data);
+	}
+
+	void Arena::reset()
+	{
+		for(int i=(int)dtors.size()-1; i>=0; i--)
+			dtors[i].fn(dtors[i].obj);
+		dtors.clear();
+
+		current	= blocks.empty() ? -1 : 0;
+		ptr		= blocks.empty() ? NULL : blocks[0].data;
+		left	= blocks.empty() ? 0 : blocks[0].size;
+		in_use	= 0;
+	}
+
+	//Moves on to the next block which is big enough, blocks which are skipped
+	//stay unused until the next reset
+	void* Arena::alloc_slow(size_t size)
+	{
+		in_use += block_size_of(current) - left;
+
+		int b = current + 1;
+		while(b < (int)blocks.size() && blocks[b].size < size)
+			b++;
+
+		if(b >= (int)blocks.size())
+		{
+			Block block;
+			block.size = size > block_size ? size : block_size;
+			block.data = (char*)malloc(block.size);
+			if(block.data == NULL)
+				throw std::bad_alloc();
+			blocks.push_back(block);
+			b = blocks.size() - 1;
+		}
+
+		current	= b;
+		ptr		= blocks[b].data + size;
+		left	= blocks[b].size - size;
+		return blocks[b].data;
+	}
+};
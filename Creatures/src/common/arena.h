@@ -0,0 +1,97 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <vector>
+#include <cstddef>
+
+namespace Common
+{
+	//Bump allocator for a batch of objects which all die together.
+	//
+	//	Objects are placed with new (arena) T(...).  Pass the result through
+	//	own() if T has a destructor which has to run.  reset() runs those
+	//	destructors, newest first, and rewinds the arena without giving its
+	//	memory back, so a reused arena stops calling malloc altogether.
+	//	An arena is not thread safe, give each thread (or creature) its own.
+	class Arena
+	{
+	public:
+		explicit Arena(size_t block_size = 16384);
+		~Arena();
+
+		//Returns size bytes aligned for any type
+		void* alloc(size_t size)
+		{
+			size = (size + ALIGN - 1) & ~(ALIGN - 1);
+			if(size > left)
+				return alloc_slow(size);
+			void* p = ptr;
+			ptr += size;
+			left -= size;
+			return p;
+		}
+
+		//Runs ~T() on obj when the arena is reset
+		template<class T> T* own(T* obj)
+		{
+			dtors.push_back(Dtor(&destroy<T>, obj));
+			return obj;
+		}
+
+		//Destroys everything which was owned and frees all allocations
+		void reset();
+
+		//Bytes handed out since the last reset
+		size_t used() const { return in_use + (block_size_of(current) - left); }
+
+	private:
+		static const size_t ALIGN = 16;
+
+		struct Dtor
+		{
+			void	(*fn)(void*);
+			void*	obj;
+
+			Dtor(void (*fn_)(void*), void* obj_) : fn(fn_), obj(obj_) {}
+		};
+
+		struct Block
+		{
+			char*	data;
+			size_t	size;
+		};
+
+		template<class T> static void destroy(void* obj)
+		{
+			static_cast<T*>(obj)->~T();
+		}
+
+		void* alloc_slow(size_t size);
+		size_t block_size_of(int b) const { return b < 0 ? 0 : blocks[b].size; }
+
+		size_t				block_size;
+		std::vector<Block>	blocks;
+		std::vector<Dtor>	dtors;
+		int					current;	//Block being carved up, -1 if none
+		char*				ptr;
+		size_t				left;
+		size_t				in_use;		//Bytes used in blocks before current
+
+		//Not copyable
+		Arena(const Arena&);
+		Arena& operator=(const Arena&);
+	};
+};
+
+//Placement new into an arena.  The matching delete is only called by the
+//compiler if a constructor throws, the memory comes back on reset().
+inline void* operator new(size_t size, Common::Arena& arena)
+{
+	return arena.alloc(size);
+}
+
+inline void operator delete(void*, Common::Arena&)
+{
+}
+
+#endif
@@ -0,0 +1,141 @@
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+#include <cstring>
+
+namespace Common
+{
+	//Polynomial approximations of the libm functions used by the gates.
+	//
+	//	Everything is straight line code on floats, so a loop over an array
+	//	which calls these gets vectorized.  Arguments are reduced in single
+	//	precision, so sin/tan lose accuracy for |x| much beyond 1e4.
+	//	Worst case errors are measured by check_fast_math() in batch_circuit.h.
+
+	inline float fm_bits_to_float(int i)
+	{
+		float f;
+		memcpy(&f, &i, sizeof(f));
+		return f;
+	}
+
+	inline int fm_float_to_bits(float f)
+	{
+		int i;
+		memcpy(&i, &f, sizeof(i));
+		return i;
+	}
+
+	//Round to nearest, valid for |x| < 2^22
+	inline float fm_round(float x)
+	{
+		const float magic = 12582912.f;		//1.5 * 2^23
+		return (x + magic) - magic;
+	}
+
+	//sin on [-pi/2, pi/2]
+	inline float fm_sin_poly(float r)
+	{
+		float r2 = r * r;
+		return r * (1.f + r2 * (-1.6666667e-1f + r2 * (8.3333310e-3f +
+			r2 * (-1.9840874e-4f + r2 * (2.7525562e-6f - r2 * 2.3889859e-8f)))));
+	}
+
+	//cos on [-pi/2, pi/2]
+	inline float fm_cos_poly(float r)
+	{
+		float r2 = r * r;
+		return 1.f + r2 * (-0.5f + r2 * (4.1666638e-2f + r2 * (-1.3888378e-3f +
+			r2 * (2.4760495e-5f - r2 * 2.6051615e-7f))));
+	}
+
+	//x - k pi, with pi split in three so the product is exact for |k| < 2^12
+	inline float fm_reduce_pi(float x, float k)
+	{
+		return ((x - k * 3.140625f) - k * 9.6750259399e-4f) - k * 1.5099580253e-7f;
+	}
+
+	inline float fast_sin(float x)
+	{
+		//x = k pi + r, r in [-pi/2, pi/2], sin(x) = (-1)^k sin(r)
+		float k = fm_round(x * 0.31830988618f);
+		float s = fm_sin_poly(fm_reduce_pi(x, k));
+		int odd = (int)k & 1;
+		return odd ? -s : s;
+	}
+
+	inline float fast_tan(float x)
+	{
+		//tan has period pi, so only r matters.  Within pi/4 of a pole use
+		//tan(x) = -cot(d), with d the distance to the pole reduced straight
+		//from x, otherwise rounding in r swamps the result.
+		float k = fm_round(x * 0.31830988618f);
+		float r = fm_reduce_pi(x, k);
+		float h = fm_round(x * 0.31830988618f - 0.5f) + 0.5f;
+		float d = fm_reduce_pi(x, h);
+		float a = r < 0.f ? -r : r;
+		return a > 0.78539816340f ?
+			-fm_cos_poly(d) / fm_sin_poly(d) :
+			fm_sin_poly(r) / fm_cos_poly(r);
+	}
+
+	inline float fast_exp(float x)
+	{
+		//x = n ln2 + r, exp(x) = 2^n exp(r)
+		float xc = x > 88.7228f ? 88.7228f : (x < -87.3365f ? -87.3365f : x);
+		float n = fm_round(xc * 1.44269504089f);
+		float r = (xc - n * 0.693359375f) + n * 2.12194440e-4f;
+		float p = 1.f + r * (1.f + r * (0.5f + r * (1.6666667e-1f +
+			r * (4.1666668e-2f + r * (8.3333338e-3f + r * 1.3888889e-3f)))));
+
+		//n is in [-126, 128], split 2^n in two so neither half overflows
+		int n1 = (int)n >> 1, n2 = (int)n - n1;
+		float res = p * fm_bits_to_float((n1 + 127) << 23) * fm_bits_to_float((n2 + 127) << 23);
+
+		//Same limits as libm, past them clamping would only be approximate
+		res = x > 88.7228f ? fm_bits_to_float(0x7f800000) : res;
+		res = x < -87.3365f ? 0.f : res;
+		return x != x ? x : res;
+	}
+
+	//Only for normal x > 0, the log gate never passes anything else
+	inline float fast_log(float x)
+	{
+		//x = 2^e m, m in [sqrt(1/2), sqrt(2))
+		int bits = fm_float_to_bits(x);
+		int e = ((bits >> 23) & 0xff) - 127;
+		float m = fm_bits_to_float((bits & 0x007fffff) | 0x3f800000);
+		int big = m > 1.41421356f;
+		m = big ? m * 0.5f : m;
+		e = big ? e + 1 : e;
+
+		//log(m) = 2 atanh(s)
+		float s = (m - 1.f) / (m + 1.f);
+		float s2 = s * s;
+		float l = 2.f * s * (1.f + s2 * (3.3333334e-1f + s2 * (2.0000000e-1f +
+			s2 * (1.4285715e-1f + s2 * (1.1111111e-1f + s2 * 9.0909094e-2f)))));
+		float res = l + (float)e * 0.69314718056f;
+		return bits >= 0x7f800000 ? x : res;		//inf and nan
+	}
+
+	inline float fast_atan(float x)
+	{
+		//atan(x) = sign(x) (pi/2 - atan(1/|x|)) for |x| > 1, then
+		//atan(a) = pi/4 + atan((a-1)/(a+1)) for a > tan(pi/8)
+		float a = x < 0.f ? -x : x;
+		int inv = a > 1.f;
+		a = inv ? 1.f / a : a;
+		int shift = a > 0.41421356f;
+		a = shift ? (a - 1.f) / (a + 1.f) : a;
+
+		float a2 = a * a;
+		float p = a * (1.f + a2 * (-3.3333315e-1f + a2 * (1.9999354e-1f +
+			a2 * (-1.4264871e-1f + a2 * (1.0855731e-1f - a2 * 7.1733504e-2f)))));
+		p = shift ? p + 0.78539816340f : p;
+		p = inv ? 1.57079632679f - p : p;
+		p = x < 0.f ? -p : p;
+		return x != x ? x : p;
+	}
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "common/mapped_file.h"
+
+namespace Common
+{
+	bool MappedFile::open(const char* path)
+	{
+		close();
+		
+		fd = ::open(path, O_RDONLY);
+		if(fd < 0)
+			return false;
+		
+		struct stat st;
+		if(fstat(fd, &st) != 0)
+		{
+			close();
+			return false;
+		}
+		size = st.st_size;
+		
+		//Empty files can't be mapped
+		if(size == 0)
+			return true;
+		
+		void* ptr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(ptr == MAP_FAILED)
+		{
+			close();
+			return false;
+		}
+		data = (const char*)ptr;
+		return true;
+	}
+	
+	void MappedFile::close()
+	{
+		if(data != NULL)
+			munmap((void*)data, size);
+		if(fd >= 0)
+			::close(fd);
+		data = NULL;
+		size = 0;
+		fd = -1;
+	}
+};
@@ -0,0 +1,31 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+namespace Common
+{
+	//A read only memory mapped file
+	struct MappedFile
+	{
+		MappedFile() : data(NULL), size(0), fd(-1) {}
+		~MappedFile() { close(); }
+		
+		//Maps a file, returns false on failure
+		bool open(const char* path);
+		void close();
+		
+		const char*	data;
+		size_t		size;
+		
+	private:
+		int			fd;
+		
+		//Not copyable
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+	};
+};
+
+#endif
+
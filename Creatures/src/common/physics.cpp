@@ -1,6 +1,7 @@
 #include "common/sys_includes.h"
 #include "physics.h"
 #include <vector>
+#include <pthread.h>
 
 using namespace std;
 
@@ -11,8 +12,16 @@ namespace Common
 	NxPhysicsSDK*	sdk;
 	NxScene*		scene;
 	
+	int floor_height = -75.;
+	
+	bool pool_objects = true;
+	
+	//SDK lock
+	pthread_mutex_t	sdk_mutex = PTHREAD_MUTEX_INITIALIZER;
+	
 	//Actor group stuff
 	vector<NxActorGroup> actor_groups;
+	pthread_mutex_t	group_mutex = PTHREAD_MUTEX_INITIALIZER;
 	
 	void phys_init()
 	{
@@ -25,10 +34,7 @@ namespace Common
 		}
 		
 		//Create the scene
-		NxSceneDesc scene_desc;
-		//scene_desc.setToDefault();
-		scene_desc.gravity = NxVec3(0.f, -9.81f, 0.f);
-		scene = sdk->createScene(scene_desc);
+		scene = create_scene();
 		
 		
 		//Just fill with set of numbers
@@ -37,17 +43,131 @@ namespace Common
 			actor_groups[i] = i+1;
 	}
 	
+	NxScene* create_scene()
+	{
+		lock_sdk();
+		NxSceneDesc scene_desc;
+		//scene_desc.setToDefault();
+		scene_desc.gravity = NxVec3(0.f, -9.81f, 0.f);
+		NxScene* res = sdk->createScene(scene_desc);
+		unlock_sdk();
+		
+		if(res == NULL)
+		{
+			printf("Failed to create scene\n");
+			exit(1);
+		}
+		
+		// Set default material (values taken from boxes demo, need to mess with this)
+		NxMaterial* defaultMaterial = res->getMaterialFromIndex(0);
+		defaultMaterial->setRestitution(0.f);
+		defaultMaterial->setStaticFriction(.5f);
+		defaultMaterial->setDynamicFriction(.5f);
+
+		// Create ground plane
+		NxPlaneShapeDesc planeDesc;
+		planeDesc.normal = NxVec3(0, 1, 0);
+		planeDesc.d = floor_height;
+
+		NxActorDesc actorDesc;
+		actorDesc.shapes.pushBack(&planeDesc);
+		res->createActor(actorDesc);
+		
+		res->userData = new ActorPool();
+		
+		return res;
+	}
+	
+	//Parked actors go down with the scene
+	void release_scene(NxScene* s)
+	{
+		delete actor_pool(s);
+		
+		lock_sdk();
+		sdk->releaseScene(*s);
+		unlock_sdk();
+	}
+	
+	void lock_sdk()
+	{
+		pthread_mutex_lock(&sdk_mutex);
+	}
+	
+	void unlock_sdk()
+	{
+		pthread_mutex_unlock(&sdk_mutex);
+	}
+	
 	NxActorGroup get_group()
 	{
+		pthread_mutex_lock(&group_mutex);
 		NxActorGroup res = actor_groups[actor_groups.size()-1];
 		actor_groups.pop_back();
+		pthread_mutex_unlock(&group_mutex);
 		return res;
 	}
 	
 	void release_group(NxActorGroup group)
 	{
+		pthread_mutex_lock(&group_mutex);
 		actor_groups.push_back(group);
+		pthread_mutex_unlock(&group_mutex);
+	}
+	
+	NxCollisionGroup lane_group(int lane, int num_lanes)
+	{
+		return num_lanes > 1 ? lane + 1 : 0;
+	}
+	
+	void isolate_lanes(NxScene* s, int num_lanes)
+	{
+		for(int i=0; i<num_lanes; i++)
+		for(int j=i+1; j<num_lanes; j++)
+			s->setGroupCollisionFlag(lane_group(i, num_lanes), lane_group(j, num_lanes), false);
+	}
+	
+	void PoolStats::add(const PoolStats& other)
+	{
+		created		+= other.created;
+		reused		+= other.reused;
+		create_time	+= other.create_time;
+		reuse_time	+= other.reuse_time;
+	}
+	
+	double PoolStats::saved(const PoolStats& before) const
+	{
+		int n = reused - before.reused;
+		if(n == 0 || created == 0)
+			return 0.;
+		return n * (create_time / created) - (reuse_time - before.reuse_time);
+	}
+	
+	ActorPool* actor_pool(NxScene* s)
+	{
+		return (ActorPool*)s->userData;
+	}
+	
+	//A frozen actor without collisions is skipped by the solver and the
+	//broad phase, so it can wait where it is
+	void park_actor(NxScene* s, NxActor* actor)
+	{
+		actor->userData = NULL;
+		actor->setLinearVelocity(NxVec3(0, 0, 0));
+		actor->setAngularVelocity(NxVec3(0, 0, 0));
+		actor->raiseActorFlag(NX_AF_DISABLE_COLLISION);
+		actor->raiseBodyFlag(NX_BF_FROZEN);
+		actor->putToSleep();
+		actor_pool(s)->parked.push_back(actor);
+	}
+	
+	NxActor* unpark_actor(NxScene* s)
+	{
+		vector<NxActor*>& parked = actor_pool(s)->parked;
+		if(parked.size() == 0)
+			return NULL;
+		NxActor* res = parked[parked.size()-1];
+		parked.pop_back();
+		return res;
 	}
-
 	
 };
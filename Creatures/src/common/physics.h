@@ -1,18 +1,77 @@
 #ifndef PHYSICS_H
 #define PHYSICS_H
 
+#include <vector>
+
 namespace Common
 {
 	//PhysX variables
 	extern NxPhysicsSDK*	sdk;
 	extern NxScene*			scene;
+	
+	//Height of the ground plane
+	extern int				floor_height;
 
 	//Initialize physics
 	void phys_init();
 	
+	//Creates a new scene with the ground plane and default material set up
+	NxScene* create_scene();
+	void release_scene(NxScene*);
+	
+	//Serializes calls on the SDK object (mesh/skeleton cooking etc.), scenes
+	//may be used from separate threads but the SDK itself may not
+	void lock_sdk();
+	void unlock_sdk();
+	
 	//Actor group stuff
 	NxActorGroup get_group();
 	void release_group(NxActorGroup);
+	
+	//Creatures sharing a scene are kept apart by shape collision groups.
+	//The ground is in group 0, which touches everything, so with more than
+	//one lane lane i goes in group i+1.  Lanes still collide with themselves.
+	const int MAX_LANES = 31;
+	NxCollisionGroup lane_group(int lane, int num_lanes);
+	void isolate_lanes(NxScene* s, int num_lanes);
+	
+	//Reuse the actors and CCD skeletons of released creatures instead of
+	//creating new ones (default true)
+	extern bool pool_objects;
+	
+	//Number of scene objects a pool handed out and what they cost
+	struct PoolStats
+	{
+		int		created, reused;
+		double	create_time, reuse_time;
+		
+		PoolStats() : created(0), reused(0), create_time(0.), reuse_time(0.) {}
+		
+		void add(const PoolStats& other);
+		
+		//Time saved by the reuses since before, going by the average cost
+		//of creating an object over the whole run
+		double saved(const PoolStats& before) const;
+	};
+	
+	//Actors of released creatures, parked in their scene until the next
+	//creature built there takes them over.  Every scene made by
+	//create_scene() has one, hung off its userData.
+	struct ActorPool
+	{
+		std::vector<NxActor*>	parked;
+		PoolStats				stats;
+	};
+	
+	ActorPool* actor_pool(NxScene* s);
+	
+	//Freezes the actor and turns off its collisions, its joints must be
+	//gone already
+	void park_actor(NxScene* s, NxActor* actor);
+	
+	//Takes the last parked actor, NULL if there is none.  The actor is
+	//still frozen, the caller sets it up again.
+	NxActor* unpark_actor(NxScene* s);
 };
 
 
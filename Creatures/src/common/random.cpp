@@ -0,0 +1,49 @@
+#include "common/random.h"
+
+namespace Common
+{
+	//Murmur3 finalizer, spreads every input bit over the whole word
+	static unsigned int mix(unsigned int h)
+	{
+		h ^= h >> 16;
+		h *= 0x85ebca6bu;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35u;
+		h ^= h >> 16;
+		return h;
+	}
+
+	//Each state word hashes the seed, the stream and its own index, so nearby
+	//seeds or streams don't start out correlated.  The all zero state is the
+	//one xoshiro can't leave, so it's patched.
+	void Random::reseed(unsigned long seed, unsigned long stream)
+	{
+		unsigned int lo = (unsigned int)seed;
+		unsigned int hi = (unsigned int)((seed >> 16) >> 16);
+		unsigned int st = (unsigned int)stream ^ mix((unsigned int)((stream >> 16) >> 16));
+
+		for(int i=0; i<STATE_SIZE; i++)
+			s[i] = mix(mix(mix(lo + 0x9e3779b9u * (i + 1)) ^ hi) + st * 0x6a09e667u + i);
+
+		if((s[0] | s[1] | s[2] | s[3]) == 0)
+			s[0] = 1;
+
+		//Burn in a little, the first outputs of a fresh state are the weakest
+		for(int i=0; i<8; i++)
+			next();
+	}
+
+	void Random::get_state(unsigned int state[STATE_SIZE]) const
+	{
+		for(int i=0; i<STATE_SIZE; i++)
+			state[i] = s[i];
+	}
+
+	void Random::set_state(const unsigned int state[STATE_SIZE])
+	{
+		for(int i=0; i<STATE_SIZE; i++)
+			s[i] = state[i];
+		if((s[0] | s[1] | s[2] | s[3]) == 0)
+			s[0] = 1;
+	}
+};
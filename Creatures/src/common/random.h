@@ -0,0 +1,71 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+namespace Common
+{
+	//Seedable random number generator, xoshiro128**.
+	//
+	//	Unlike drand48/rand the whole state is in the object, so each thread
+	//	(or each child being bred) can own a stream and the results don't
+	//	depend on who else draws numbers in between.  Seeding with the same
+	//	seed and a different stream number gives an unrelated sequence.
+	//	Assumes a 32 bit unsigned int.
+	class Random
+	{
+	public:
+		static const int STATE_SIZE = 4;
+
+		explicit Random(unsigned long seed = 0, unsigned long stream = 0)
+		{
+			reseed(seed, stream);
+		}
+
+		void reseed(unsigned long seed, unsigned long stream = 0);
+
+		//32 random bits
+		unsigned int next()
+		{
+			unsigned int res = rotl(s[1] * 5, 7) * 9;
+			unsigned int t = s[1] << 9;
+			s[2] ^= s[0];
+			s[3] ^= s[1];
+			s[1] ^= s[2];
+			s[0] ^= s[3];
+			s[2] ^= t;
+			s[3] = rotl(s[3], 11);
+			return res;
+		}
+
+		//Uniform in [0,1), in steps of 2^-32.  Stands in for drand48().
+		double uniform()
+		{
+			return next() * (1. / 4294967296.);
+		}
+
+		//Uniform integer in [0,n), n > 0
+		int below(int n)
+		{
+			return (int)(uniform() * n);
+		}
+
+		//Uniform in [0, 2^31).  Stands in for rand().
+		int integer()
+		{
+			return (int)(next() >> 1);
+		}
+
+		//Saving and restoring the state replays the same sequence
+		void get_state(unsigned int state[STATE_SIZE]) const;
+		void set_state(const unsigned int state[STATE_SIZE]);
+
+	private:
+		unsigned int s[STATE_SIZE];
+
+		static unsigned int rotl(unsigned int x, int k)
+		{
+			return (x << k) | (x >> (32 - k));
+		}
+	};
+};
+
+#endif
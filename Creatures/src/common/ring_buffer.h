@@ -0,0 +1,73 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <vector>
+
+namespace Common
+{
+	//Fixed size queue between exactly one producer and one consumer thread.
+	//
+	//	Neither side ever takes a lock or waits, push() fails when the queue
+	//	is full and pop() when it is empty.  Each index is only written by
+	//	its own side, the barriers make sure a slot is filled before the
+	//	consumer can see it and emptied before the producer can reuse it.
+	//	Uses the GCC __sync builtins.
+	template<class T>
+	class RingBuffer
+	{
+	public:
+		//Capacity is rounded up to a power of two
+		explicit RingBuffer(int capacity) : head(0), tail(0)
+		{
+			unsigned int n = 1;
+			while((int)n < capacity)
+				n <<= 1;
+			slots.resize(n);
+			mask = n - 1;
+		}
+
+		//Producer side
+		bool push(const T& x)
+		{
+			unsigned int h = head;
+			if(h - tail > mask)
+				return false;
+			slots[h & mask] = x;
+			__sync_synchronize();
+			head = h + 1;
+			return true;
+		}
+
+		//Consumer side
+		bool pop(T& x)
+		{
+			unsigned int t = tail;
+			if(t == head)
+				return false;
+			__sync_synchronize();
+			x = slots[t & mask];
+			__sync_synchronize();
+			tail = t + 1;
+			return true;
+		}
+
+		int capacity() const { return mask + 1; }
+
+	private:
+		std::vector<T>			slots;
+		unsigned int			mask;
+
+		//Kept on separate cache lines, each one is written by a different thread
+		char					pad0[64];
+		volatile unsigned int	head;
+		char					pad1[64];
+		volatile unsigned int	tail;
+		char					pad2[64];
+
+		//Not copyable
+		RingBuffer(const RingBuffer&);
+		RingBuffer& operator=(const RingBuffer&);
+	};
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <vector>
+#include <cstddef>
+
+namespace Common
+{
+	//Reference counted handle to a value which is copied on the first write.
+	//
+	//	Copying a handle only bumps a counter, so any number of owners may
+	//	share the same value.  edit() gives back a private copy if the value
+	//	is still shared.  Counts are updated atomically, so handles to one
+	//	value may be copied and dropped on separate threads, but a value must
+	//	not be edited while another thread reads it through the same handle.
+	template<class T> class Shared
+	{
+	public:
+		Shared() : block(NULL) {}
+		explicit Shared(const T& value) : block(new Block(value)) {}
+		Shared(const Shared& other) : block(other.block) { acquire(block); }
+		~Shared() { release(block); }
+
+		Shared& operator=(const Shared& other)
+		{
+			Block* b = other.block;
+			acquire(b);
+			release(block);
+			block = b;
+			return *this;
+		}
+
+		bool null() const { return block == NULL; }
+		const T& operator*() const { return block->value; }
+		const T* operator->() const { return &block->value; }
+
+		//Returns a value owned only by this handle
+		T& edit()
+		{
+			if(block == NULL)
+			{
+				block = new Block(T());
+			}
+			else if(block->refs > 1)
+			{
+				Block* b = new Block(block->value);
+				release(block);
+				block = b;
+			}
+			return block->value;
+		}
+
+	private:
+		struct Block
+		{
+			volatile int	refs;
+			T				value;
+
+			Block(const T& value_) : refs(1), value(value_) {}
+		};
+
+		static void acquire(Block* b)
+		{
+			if(b != NULL)
+				__sync_add_and_fetch(&b->refs, 1);
+		}
+
+		static void release(Block* b)
+		{
+			if(b != NULL && __sync_sub_and_fetch(&b->refs, 1) == 0)
+				delete b;
+		}
+
+		Block* block;
+	};
+
+
+	//A vector with copy on write elements.
+	//
+	//	Both the list itself and each element are shared, so copying the vector
+	//	is O(1) and editing one element of a copy only duplicates the list of
+	//	handles plus that one element.  Reads go through operator[], writes
+	//	must ask for edit(i).
+	template<class T> class SharedVector
+	{
+	public:
+		size_t size() const { return items.null() ? 0 : items->size(); }
+		bool empty() const { return size() == 0; }
+
+		const T& operator[](size_t i) const { return *(*items)[i]; }
+		const T& back() const { return *items->back(); }
+
+		T& edit(size_t i) { return items.edit()[i].edit(); }
+		T& edit_back() { return items.edit().back().edit(); }
+
+		void push_back(const T& value) { items.edit().push_back(Shared<T>(value)); }
+		void pop_back() { items.edit().pop_back(); }
+		void clear() { items = Shared<List>(); }
+
+		void reserve(size_t n) { items.edit().reserve(n); }
+
+		//New elements are default constructed
+		void resize(size_t n)
+		{
+			List& list = items.edit();
+			if(n < list.size())
+				list.erase(list.begin() + n, list.end());
+			while(list.size() < n)
+				list.push_back(Shared<T>(T()));
+		}
+
+		void erase(size_t i)
+		{
+			List& list = items.edit();
+			list.erase(list.begin() + i);
+		}
+
+		//Element dst becomes another reference to element src
+		void copy(size_t dst, size_t src)
+		{
+			List& list = items.edit();
+			list[dst] = list[src];
+		}
+
+	private:
+		typedef std::vector< Shared<T> > List;
+		Shared<List> items;
+	};
+};
+
+#endif
+
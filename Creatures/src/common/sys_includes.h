@@ -3,6 +3,8 @@
 #define SYS_INCLUDE_H
 
 //These names are different from system to system
+//HEADLESS builds (the batch driver) skip the display stuff entirely
+#ifndef HEADLESS
 #include <GL/glew.h>
 #include <GL/glui.h>
 #include <GL/glu.h>
@@ -10,6 +12,7 @@
 #include <GL/glext.h>
 
 #include <SDL/SDL.h>
+#endif
 
 //PhysX APIs
 #include <NxPhysics.h>
@@ -0,0 +1,26 @@
+#include <cstddef>
+#include <sys/time.h>
+#include <time.h>
+
+#include "common/timer.h"
+
+namespace Common
+{
+	double wall_time()
+	{
+		timeval tv;
+		gettimeofday(&tv, NULL);
+		return (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+	}
+	
+	double fine_time()
+	{
+#ifdef LINUX
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#else
+		return wall_time();
+#endif
+	}
+};
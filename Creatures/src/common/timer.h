@@ -0,0 +1,14 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+namespace Common
+{
+	//Wall clock time in seconds, only useful for differences
+	double wall_time();
+	
+	//Same, from a monotonic clock with nanosecond resolution where the
+	//system has one.  For timing stretches far shorter than a microsecond.
+	double fine_time();
+};
+
+#endif
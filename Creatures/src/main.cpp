@@ -38,51 +38,45 @@ void main_loop()
 	//Initialize project specific stuff
 	Game::init();
 	
+	//The simulation runs on its own thread, this one only handles input
+	//and draws whatever the newest snapshot is
 	while(true)
 	{
-		
-		for(int i=0; i<=frame_skip; i++)
+		SDL_Event event;
+		while(SDL_PollEvent(&event))
 		{
-			SDL_Event event;
-			while(SDL_PollEvent(&event))
+			switch(event.type)
 			{
-				switch(event.type)
-				{
-					case SDL_VIDEORESIZE:
-						XRes = event.resize.w;
-						YRes = event.resize.h;
-		
-						window = SDL_SetVideoMode(XRes, YRes, 32, 
-							SDL_HWSURFACE | 
-							(fullscreen ? SDL_FULLSCREEN : SDL_RESIZABLE) |
-							SDL_OPENGL |
-							SDL_HWPALETTE);
-					break;
-		
-					case SDL_KEYDOWN:
-						if(event.key.keysym.sym == SDLK_ESCAPE)
-							exit(0);
-					break;
-		
-					case SDL_QUIT:
+				case SDL_VIDEORESIZE:
+					XRes = event.resize.w;
+					YRes = event.resize.h;
+	
+					window = SDL_SetVideoMode(XRes, YRes, 32, 
+						SDL_HWSURFACE | 
+						(fullscreen ? SDL_FULLSCREEN : SDL_RESIZABLE) |
+						SDL_OPENGL |
+						SDL_HWPALETTE);
+				break;
+	
+				case SDL_KEYDOWN:
+					if(event.key.keysym.sym == SDLK_ESCAPE)
+					{
+						Game::shutdown();
 						exit(0);
-		
-					default: break;
-				}
-			}
-			//Update input
-			key_update();
-
-		
-			if(i > 0)
-			{
-				scene->flushStream();
-				scene->fetchResults(NX_RIGID_BODY_FINISHED, true);
+					}
+				break;
+	
+				case SDL_QUIT:
+					Game::shutdown();
+					exit(0);
+	
+				default: break;
 			}
-			
-			Game::update();
-			scene->simulate(delta_t);
 		}
+		//Update input
+		key_update();
+		
+		Game::update();
 		
 		
 		//Draw 3D component
@@ -116,12 +110,8 @@ void main_loop()
 		glFlush();
 		SDL_GL_SwapBuffers();
 		
-		//Wait for physics calculations to finish
-		scene->flushStream();
-		scene->fetchResults(NX_RIGID_BODY_FINISHED, true);
-		
 		//Synchronize frame rate
-		last_time += delta_t * 1000.;
+		last_time += frame_time * 1000.;
 		long long compute_time = (long long)last_time - (long long)SDL_GetTicks();
 		if(compute_time > 0)
 			SDL_Delay(compute_time);
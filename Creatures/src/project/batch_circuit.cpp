@@ -0,0 +1,463 @@
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cassert>
+#include <cstdlib>
+#include <algorithm>
+
+#include "common/fast_math.h"
+
+#include "project/batch_circuit.h"
+
+using namespace std;
+using namespace Common;
+
+namespace Game
+{
+
+const int W = BATCH_WIDTH;
+
+bool BatchCircuit::compatible(const CompiledCircuit& a, const CompiledCircuit& b)
+{
+	if(a.ops.size() != b.ops.size() ||
+	   a.args != b.args ||
+	   a.values.size() != b.values.size() ||
+	   a.state.size() != b.state.size())
+		return false;
+
+	for(int i=0; i<(int)a.ops.size(); i++)
+	{
+		const CompiledCircuit::Op& x = a.ops[i];
+		const CompiledCircuit::Op& y = b.ops[i];
+		if(x.code != y.code || x.in != y.in || x.num_in != y.num_in ||
+		   x.out != y.out || x.num_out != y.num_out || x.state != y.state)
+			return false;
+	}
+	return true;
+}
+
+//Lanes past the last circuit run a copy of lane 0, which keeps every row
+//full of sane numbers without any masking
+BatchCircuit::BatchCircuit(const vector<CompiledCircuit*>& circuits, bool approx_) :
+	approx(approx_),
+	lanes(circuits)
+{
+	assert(lanes.size() > 0 && (int)lanes.size() <= W);
+
+	const CompiledCircuit& c0 = *lanes[0];
+	values.resize(c0.values.size() * W);
+	state.resize(c0.state.size() * W);
+	externs.resize(c0.ops.size() * W, NULL);
+
+	for(int l=0; l<W; l++)
+	{
+		const CompiledCircuit& c = *lanes[l < (int)lanes.size() ? l : 0];
+		assert(compatible(c0, c));
+
+		for(int i=0; i<(int)c.values.size(); i++)
+			values[i*W + l] = c.values[i];
+		for(int i=0; i<(int)c.state.size(); i++)
+			state[i*W + l] = c.state[i];
+		if(l < (int)lanes.size())
+		{
+			for(int n=0; n<(int)c.ops.size(); n++)
+				externs[n*W + l] = c.ops[n].gate;
+		}
+	}
+}
+
+void BatchCircuit::store()
+{
+	for(int l=0; l<(int)lanes.size(); l++)
+	{
+		CompiledCircuit& c = *lanes[l];
+		for(int i=0; i<(int)c.values.size(); i++)
+			c.values[i] = values[i*W + l];
+		for(int i=0; i<(int)c.state.size(); i++)
+			c.state[i] = state[i*W + l];
+	}
+}
+
+//Unary kernels, one row at a time.  The libm versions are spelled the same
+//way as in CompiledCircuit::update() so they round the same way.
+static void row_sine(float* o, const float* x, const float* st, bool approx)
+{
+	const float* freq	= st;
+	const float* ampl	= st + W;
+	const float* phase	= st + 2*W;
+	if(approx)
+	{
+		for(int l=0; l<W; l++)
+			o[l] = ampl[l] * fast_sin(x[l]*freq[l] + phase[l]);
+	}
+	else
+	{
+		for(int l=0; l<W; l++)
+			o[l] = ampl[l] * sin(x[l]*freq[l] + phase[l]);
+	}
+}
+
+static void row_exp(float* o, const float* x, bool approx)
+{
+	if(approx)
+	{
+		for(int l=0; l<W; l++)
+			o[l] = fast_exp(x[l]);
+	}
+	else
+	{
+		for(int l=0; l<W; l++)
+			o[l] = exp(x[l]);
+	}
+}
+
+//fast_log only takes normal numbers, the guard keeps it away from the rest
+static void row_log(float* o, const float* x, bool approx)
+{
+	if(approx)
+	{
+		for(int l=0; l<W; l++)
+		{
+			float y = fast_log(x[l] > 1e-6f ? x[l] : 1.f);
+			o[l] = x[l] <= 1e-6 ? 0.f : y;
+		}
+	}
+	else
+	{
+		for(int l=0; l<W; l++)
+			o[l] = x[l] <= 1e-6 ? 0.f : log(x[l]);
+	}
+}
+
+static void row_tan(float* o, const float* x, bool approx)
+{
+	if(approx)
+	{
+		for(int l=0; l<W; l++)
+			o[l] = fast_tan(x[l]);
+	}
+	else
+	{
+		for(int l=0; l<W; l++)
+			o[l] = tan(x[l]);
+	}
+}
+
+static void row_atan(float* o, const float* x, bool approx)
+{
+	if(approx)
+	{
+		for(int l=0; l<W; l++)
+			o[l] = fast_atan(x[l]);
+	}
+	else
+	{
+		for(int l=0; l<W; l++)
+			o[l] = atan(x[l]);
+	}
+}
+
+//Same as CompiledCircuit::update(), with every scalar turned into a row.  The
+//settle passes are left out, prescreen() turns them off for dry runs.
+void BatchCircuit::update()
+{
+	const CompiledCircuit& prog = *lanes[0];
+	if(prog.ops.empty())
+		return;
+
+	float*		v	= values.empty() ? NULL : &values[0];
+	float*		st	= state.empty() ? NULL : &state[0];
+	const int*	a	= &prog.args[0];
+	float		s[W];
+
+	for(int n=0; n<(int)prog.ops.size(); n++)
+	{
+		const CompiledCircuit::Op& op = prog.ops[n];
+		const int* in = a + op.in;
+		const int* out = a + op.out;
+		float* ost = st + op.state * W;
+
+		switch(op.code)
+		{
+			case OP_EXTERN:
+				for(int l=0; l<(int)lanes.size(); l++)
+				{
+					Gate* g = externs[n*W + l];
+					for(int i=0; i<op.num_in; i++)
+						g->inputs[i]->write(v[in[i]*W + l]);
+					g->update();
+					for(int i=0; i<op.num_out; i++)
+						v[out[i]*W + l] = g->outputs[i]->read();
+				}
+			break;
+
+			case OP_ADD:
+			case OP_MUL:
+			{
+				float init = op.code == OP_ADD ? 0.f : 1.f;
+				for(int l=0; l<W; l++)
+					s[l] = init;
+				for(int i=0; i<op.num_in; i++)
+				{
+					const float* x = v + in[i]*W;
+					if(op.code == OP_ADD)
+						for(int l=0; l<W; l++)
+							s[l] += x[l];
+					else
+						for(int l=0; l<W; l++)
+							s[l] *= x[l];
+				}
+				for(int j=0; j<op.num_out; j++)
+					copy(s, s + W, v + out[j]*W);
+			}
+			break;
+
+			case OP_MULTIPLEX:
+				for(int l=0; l<W; l++)
+				{
+					s[l] = 0.;
+					if(op.num_in > 0)
+					{
+						int count = ((int)ost[l] + 1) % op.num_in;
+						ost[l] = count;
+						s[l] = v[in[count]*W + l];
+					}
+				}
+				for(int j=0; j<op.num_out; j++)
+					copy(s, s + W, v + out[j]*W);
+			break;
+
+			case OP_TIMER:
+			{
+				float* time			= ost;
+				const float* incr	= ost + W;
+				const float* reset	= ost + 2*W;
+				for(int l=0; l<W; l++)
+				{
+					time[l] += incr[l];
+					while(time[l] >= reset[l])
+						time[l] -= reset[l];
+				}
+				for(int j=0; j<op.num_out; j++)
+					copy(time, time + W, v + out[j]*W);
+			}
+			break;
+
+			case OP_CONST:
+				for(int j=0; j<op.num_out; j++)
+					copy(ost, ost + W, v + out[j]*W);
+			break;
+
+			case OP_SINE:
+				for(int i=0; i<min(op.num_in, op.num_out); i++)
+					row_sine(v + out[i]*W, v + in[i]*W, ost, approx);
+			break;
+
+			case OP_EXP:
+				for(int i=0; i<min(op.num_in, op.num_out); i++)
+					row_exp(v + out[i]*W, v + in[i]*W, approx);
+			break;
+
+			case OP_LOG:
+				for(int i=0; i<min(op.num_in, op.num_out); i++)
+					row_log(v + out[i]*W, v + in[i]*W, approx);
+			break;
+
+			case OP_RECIP:
+				for(int i=0; i<min(op.num_in, op.num_out); i++)
+				{
+					float* o = v + out[i]*W;
+					const float* x = v + in[i]*W;
+					for(int l=0; l<W; l++)
+						o[l] = fabsf(x[l]) <= 1e-6 ? 0.f : (float)(1./x[l]);
+				}
+			break;
+
+			case OP_NEG:
+				for(int i=0; i<min(op.num_in, op.num_out); i++)
+				{
+					float* o = v + out[i]*W;
+					const float* x = v + in[i]*W;
+					for(int l=0; l<W; l++)
+						o[l] = -x[l];
+				}
+			break;
+
+			case OP_TAN:
+				for(int i=0; i<min(op.num_in, op.num_out); i++)
+					row_tan(v + out[i]*W, v + in[i]*W, approx);
+			break;
+
+			case OP_ATAN:
+				for(int i=0; i<min(op.num_in, op.num_out); i++)
+					row_atan(v + out[i]*W, v + in[i]*W, approx);
+			break;
+
+			case OP_MAX:
+			case OP_MIN:
+			{
+				bool is_max = op.code == OP_MAX;
+				for(int l=0; l<W; l++)
+					s[l] = is_max ? -1e20f : 1e20f;
+				for(int i=0; i<op.num_in; i++)
+				{
+					const float* x = v + in[i]*W;
+					if(is_max)
+						for(int l=0; l<W; l++)
+							s[l] = max(s[l], x[l]);
+					else
+						for(int l=0; l<W; l++)
+							s[l] = min(s[l], x[l]);
+				}
+				if(op.num_out > 0)
+					copy(s, s + W, v + out[0]*W);
+			}
+			break;
+
+			case OP_IF:
+				if(op.num_out > 0)
+				{
+					//Missing inputs read as zero
+					float* o = v + out[0]*W;
+					for(int l=0; l<W; l++)
+					{
+						float c = op.num_in > 0 ? v[in[0]*W + l] : 0.f;
+						float t = op.num_in > 1 ? v[in[1]*W + l] : 0.f;
+						float f = op.num_in > 2 ? v[in[2]*W + l] : 0.f;
+						o[l] = c > 0.f ? t : f;
+					}
+				}
+			break;
+
+			case OP_MEM:
+				for(int l=0; l<W; l++)
+				{
+					float c = op.num_in > 0 ? v[in[0]*W + l] : 0.f;
+					float x = op.num_in > 1 ? v[in[1]*W + l] : 0.f;
+					if(c > 0.)
+						ost[l] = x;
+				}
+				if(op.num_out > 0)
+					copy(ost, ost + W, v + out[0]*W);
+			break;
+
+			default: assert(false);
+		}
+	}
+}
+
+//Cheap hash of the program layout, compatible() settles collisions
+static size_t program_hash(const CompiledCircuit& c)
+{
+	size_t h = c.ops.size() * 31 + c.values.size() * 17 + c.state.size();
+	for(int i=0; i<(int)c.ops.size(); i++)
+		h = h * 1000003 + c.ops[i].code * 131 + c.ops[i].num_in * 7 + c.ops[i].num_out;
+	for(int i=0; i<(int)c.args.size(); i++)
+		h = h * 1000003 + c.args[i];
+	return h;
+}
+
+void group_circuits(
+	const vector<CompiledCircuit*>& circuits,
+	vector< vector<int> >& groups)
+{
+	groups.clear();
+
+	//Open groups for each hash, the newest one last
+	multimap<size_t, int> open;
+	for(int i=0; i<(int)circuits.size(); i++)
+	{
+		size_t h = program_hash(*circuits[i]);
+		int g = -1;
+
+		pair<multimap<size_t, int>::iterator, multimap<size_t, int>::iterator>
+			range = open.equal_range(h);
+		for(multimap<size_t, int>::iterator it=range.first; it!=range.second; ++it)
+		{
+			vector<int>& cand = groups[it->second];
+			if((int)cand.size() < W &&
+			   BatchCircuit::compatible(*circuits[cand[0]], *circuits[i]))
+			{
+				g = it->second;
+				break;
+			}
+		}
+
+		if(g < 0)
+		{
+			g = groups.size();
+			groups.push_back(vector<int>());
+			open.insert(make_pair(h, g));
+		}
+		groups[g].push_back(i);
+	}
+}
+
+//The float overloads, which is what the scalar gates call
+static float libm_sin(float x)	{ return sin(x); }
+static float libm_tan(float x)	{ return tan(x); }
+static float libm_exp(float x)	{ return exp(x); }
+static float libm_log(float x)	{ return log(x); }
+static float libm_atan(float x)	{ return atan(x); }
+
+//Each kernel is swept over a range where the gates see real traffic
+void check_fast_math(vector<MathError>& res, int samples)
+{
+	struct Sweep
+	{
+		const char*	name;
+		float		(*fast)(float);
+		float		(*ref)(float);
+		float		lo, hi;
+	};
+
+	const Sweep sweeps[] =
+	{
+		{ "sin",	fast_sin,	libm_sin,	-1e3,	1e3 },
+		{ "tan",	fast_tan,	libm_tan,	-1e2,	1e2 },
+		{ "exp",	fast_exp,	libm_exp,	-87.,	88.7 },
+		{ "log",	fast_log,	libm_log,	1e-6,	1e6 },
+		{ "atan",	fast_atan,	libm_atan,	-1e3,	1e3 },
+	};
+
+	res.clear();
+	for(int k=0; k<(int)(sizeof(sweeps) / sizeof(sweeps[0])); k++)
+	{
+		const Sweep& sw = sweeps[k];
+		MathError e;
+		e.name	= sw.name;
+		e.worst	= 0.;
+		e.at	= sw.lo;
+
+		for(int i=0; i<=samples; i++)
+		{
+			float x = sw.lo + (sw.hi - sw.lo) * ((double)i / samples);
+
+			float ref = sw.ref(x);
+			float err = fabs(sw.fast(x) - ref) / max(1.f, fabsf(ref));
+			if(!(err <= e.worst))
+			{
+				e.worst = err;
+				e.at = x;
+			}
+		}
+		res.push_back(e);
+	}
+}
+
+bool fast_math_ok(float tolerance, MathError* worst, int samples)
+{
+	vector<MathError> res;
+	check_fast_math(res, samples);
+	int w = 0;
+	for(int i=1; i<(int)res.size(); i++)
+	{
+		if(!(res[i].worst <= res[w].worst))
+			w = i;
+	}
+	if(worst != NULL)
+		*worst = res[w];
+	return res[w].worst <= tolerance;
+}
+
+};
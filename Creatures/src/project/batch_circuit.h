@@ -0,0 +1,76 @@
+#ifndef BATCH_CIRCUIT_H
+#define BATCH_CIRCUIT_H
+
+#include <vector>
+
+#include "project/circuit.h"
+
+namespace Game
+{
+
+//Number of circuits a BatchCircuit runs side by side.  8 floats fill an AVX2
+//register, build with -DBATCH_WIDTH=16 for AVX-512.  Without either the
+//lane loops fall back to SSE or plain scalar code.
+#ifndef BATCH_WIDTH
+#define BATCH_WIDTH 8
+#endif
+
+//Runs up to BATCH_WIDTH compiled circuits with the same program in lock-step.
+//
+//	Siblings which only differ in gate parameters compile to the same op and
+//	wire layout, so one pass over the program can tick all of them.  Wire
+//	values and gate state are stored lane by lane, [slot * BATCH_WIDTH + lane],
+//	so every op works on a whole row at once.  OP_EXTERN gates are still
+//	called back one lane at a time.
+struct BatchCircuit
+{
+	//Every circuit must be compatible() with the first.  With approx set the
+	//sine, tan, exp, log and atan gates use the kernels in common/fast_math.h,
+	//otherwise each lane calls libm and the results match
+	//CompiledCircuit::update() bit for bit.
+	BatchCircuit(const std::vector<CompiledCircuit*>& circuits, bool approx = false);
+
+	//True if both circuits run the same program on the same wire layout
+	static bool compatible(const CompiledCircuit& a, const CompiledCircuit& b);
+
+	//Runs one tick of every lane
+	void update();
+
+	//Copies wire values and gate state back, so each circuit can carry on alone
+	void store();
+
+	int num_lanes() const { return lanes.size(); }
+
+	bool						approx;
+
+private:
+	std::vector<CompiledCircuit*>	lanes;
+	std::vector<float>				values;		//[slot * BATCH_WIDTH + lane]
+	std::vector<float>				state;		//[offset * BATCH_WIDTH + lane]
+	std::vector<Gate*>				externs;	//[op * BATCH_WIDTH + lane], OP_EXTERN only
+};
+
+//Splits circuits into groups of compatible ones, at most BATCH_WIDTH each.
+//Groups hold indices into circuits, in their original order.
+void group_circuits(
+	const std::vector<CompiledCircuit*>& circuits,
+	std::vector< std::vector<int> >& groups);
+
+//Worst error of a fast_math kernel against libm over a sweep of inputs.  The
+//error is relative where |libm| > 1 and absolute below that.
+struct MathError
+{
+	const char*	name;
+	float		worst;
+	float		at;
+};
+
+void check_fast_math(std::vector<MathError>& res, int samples = 100000);
+
+//True if every kernel is within tolerance, e.g. before turning approx on.
+//If worst is set it gets the kernel furthest off.
+bool fast_math_ok(float tolerance, MathError* worst = NULL, int samples = 100000);
+
+};
+
+#endif
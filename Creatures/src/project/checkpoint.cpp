@@ -0,0 +1,209 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "common/sys_includes.h"
+
+#include "project/checkpoint.h"
+
+using namespace std;
+
+namespace Game
+{
+
+//Writes a whole buffer to path and syncs it, returns false on failure
+static bool write_file(const string& path, const string& buf)
+{
+	int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+		return false;
+
+	const char* ptr = buf.data();
+	size_t left = buf.size();
+	while(left > 0)
+	{
+		ssize_t n = ::write(fd, ptr, left);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			::close(fd);
+			return false;
+		}
+		ptr += n;
+		left -= n;
+	}
+
+	bool ok = fsync(fd) == 0;
+	return ::close(fd) == 0 && ok;
+}
+
+//Replaces path atomically
+static bool replace_file(const string& path, const string& buf)
+{
+	string tmp = path + ".tmp";
+	if(!write_file(tmp, buf) || rename(tmp.c_str(), path.c_str()) != 0)
+	{
+		remove(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+//Checkpoints already in dir, oldest first
+static void find_checkpoints(const string& dir, deque<string>& res)
+{
+	DIR* d = opendir(dir.c_str());
+	if(d == NULL)
+		return;
+	
+	vector< pair<int,string> > found;
+	struct dirent* e;
+	while((e = readdir(d)) != NULL)
+	{
+		string name = e->d_name;
+		if(name.size() > 8 &&
+		   name.compare(0, 4, "gen_") == 0 &&
+		   name.compare(name.size() - 4, 4, ".pop") == 0)
+			found.push_back(make_pair(atoi(name.c_str() + 4), name));
+	}
+	closedir(d);
+	
+	sort(found.begin(), found.end());
+	for(int i=0; i<(int)found.size(); i++)
+		res.push_back(found[i].second);
+}
+
+Checkpointer::Checkpointer(const string& dir_, int num_keep_) :
+	dir(dir_),
+	num_keep(num_keep_),
+	pending(NULL),
+	busy(false),
+	quit(false)
+{
+	//Snapshots of a run being resumed count towards num_keep
+	find_checkpoints(dir, written);
+	
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&work_ready, NULL);
+	pthread_cond_init(&work_done, NULL);
+
+	if(pthread_create(&thread, NULL, writer_main, this) != 0)
+		throw "Failed to start checkpoint thread";
+}
+
+Checkpointer::~Checkpointer()
+{
+	flush();
+
+	pthread_mutex_lock(&lock);
+	quit = true;
+	pthread_cond_broadcast(&work_ready);
+	pthread_mutex_unlock(&lock);
+	pthread_join(thread, NULL);
+
+	pthread_cond_destroy(&work_done);
+	pthread_cond_destroy(&work_ready);
+	pthread_mutex_destroy(&lock);
+}
+
+void Checkpointer::push(const Population& population)
+{
+	PopulationState* state = new PopulationState();
+	population.snapshot(*state);
+
+	pthread_mutex_lock(&lock);
+	if(pending != NULL)
+		delete pending;
+	pending = state;
+	pthread_cond_signal(&work_ready);
+	pthread_mutex_unlock(&lock);
+}
+
+void Checkpointer::flush()
+{
+	pthread_mutex_lock(&lock);
+	while(pending != NULL || busy)
+		pthread_cond_wait(&work_done, &lock);
+	pthread_mutex_unlock(&lock);
+}
+
+string Checkpointer::latest(const string& dir)
+{
+	ifstream in((dir + "/latest").c_str());
+	string name;
+	if(!(in >> name))
+		return "";
+	return dir + "/" + name;
+}
+
+void* Checkpointer::writer_main(void* data)
+{
+	((Checkpointer*)data)->run_writer();
+	return NULL;
+}
+
+void Checkpointer::run_writer()
+{
+	pthread_mutex_lock(&lock);
+	while(true)
+	{
+		while(pending == NULL && !quit)
+			pthread_cond_wait(&work_ready, &lock);
+		if(pending == NULL)
+			break;
+
+		PopulationState* state = pending;
+		pending = NULL;
+		busy = true;
+		pthread_mutex_unlock(&lock);
+
+		write(*state);
+		delete state;
+
+		pthread_mutex_lock(&lock);
+		busy = false;
+		pthread_cond_broadcast(&work_done);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+//Serializes one snapshot, then moves the latest pointer and drops old ones
+void Checkpointer::write(const PopulationState& state)
+{
+	ostringstream buf;
+	state.save(buf);
+
+	char name[64];
+	snprintf(name, sizeof(name), "gen_%06d.pop", state.generation);
+
+	if(!replace_file(dir + "/" + name, buf.str()) ||
+	   !replace_file(dir + "/latest", string(name) + "\n"))
+	{
+		cout << "Failed to write checkpoint " << dir << "/" << name << endl;
+		return;
+	}
+
+	if(written.size() > 0 && written.back() == name)
+		return;
+	written.push_back(name);
+	while((int)written.size() > num_keep)
+	{
+		remove((dir + "/" + written.front()).c_str());
+		written.pop_front();
+	}
+}
+
+};
+
@@ -0,0 +1,57 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <deque>
+#include <pthread.h>
+
+#include "project/population.h"
+
+namespace Game
+{
+
+//Writes population snapshots to disk on a background thread.
+//
+//	Each snapshot goes to <dir>/gen_NNNNNN.pop through a temporary file and a
+//	rename, so a crash never leaves a half written checkpoint behind.  Once it
+//	is on disk <dir>/latest is updated to name it.  Only the newest few
+//	snapshots are kept.
+struct Checkpointer
+{
+	Checkpointer(const string& dir, int num_keep = 3);
+
+	//Waits for pending snapshots to be written
+	~Checkpointer();
+
+	//Copies the population state and queues it.  Only the copy happens on the
+	//calling thread.  If the writer falls behind, queued snapshots which have
+	//not been started yet are replaced by the newer one.
+	void push(const Population& population);
+
+	//Blocks until everything queued so far is on disk
+	void flush();
+
+	//Path of the newest checkpoint in dir, or an empty string
+	static string latest(const string& dir);
+
+private:
+	static void* writer_main(void* data);
+	void run_writer();
+	void write(const PopulationState& state);
+
+	string					dir;
+	int						num_keep;
+	deque<string>			written;
+
+	//Queue, guarded by lock
+	pthread_t				thread;
+	pthread_mutex_t			lock;
+	pthread_cond_t			work_ready, work_done;
+	PopulationState*		pending;
+	bool					busy, quit;
+};
+
+};
+
+#endif
+
@@ -6,6 +6,9 @@
 #include <cstdlib>
 #include <utility>
 #include <cmath>
+#include <cctype>
+
+#include "common/timer.h"
 
 #include "project/circuit.h"
 
@@ -15,11 +18,11 @@ using namespace std;
 namespace Game
 {
 
-void GateFactory::perturbParams(std::vector<float>& params)
+void GateFactory::perturbParams(std::vector<float>& params, Common::Random& rng)
 {
 	for(int i=0; i<(int)params.size(); i++)
 	{
-		params[i] += 20. * (drand48() + drand48() + drand48() + drand48()  - 2.); 
+		params[i] += 20. * (rng.uniform() + rng.uniform() + rng.uniform() + rng.uniform()  - 2.); 
 	}
 }
 
@@ -42,6 +45,11 @@ struct AddGate : public Gate
 			outputs[j]->write(s);
 		}
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		return OP_ADD;
+	}
 };
 
 struct AddGateFactory : public GateFactory
@@ -55,7 +63,7 @@ struct AddGateFactory : public GateFactory
 	}
 	
 	//Generates a random vector of parameters
-	virtual std::vector<float> generateParams()
+	virtual std::vector<float> generateParams(Common::Random& rng)
 	{
 		return vector<float>(0);
 	}
@@ -67,9 +75,9 @@ struct AddGateFactory : public GateFactory
 	}
 	
 	//Creates a gate
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
-		return new AddGate();
+		return arena.own(new (arena) AddGate());
 	}
 };
 
@@ -90,15 +98,20 @@ struct MultiplyGate : public Gate
 			outputs[j]->write(s);
 		}
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		return OP_MUL;
+	}
 };
 struct MultiplyGateFactory : public AddGateFactory
 {
 	virtual ~MultiplyGateFactory() {}
 	
 	//Creates a gate
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
-		return new MultiplyGate();
+		return arena.own(new (arena) MultiplyGate());
 	}
 };
 
@@ -125,15 +138,21 @@ struct MultiplexGate : public Gate
 			outputs[j]->write(s);
 		}
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		state.push_back(count);
+		return OP_MULTIPLEX;
+	}
 };
 struct MultiplexGateFactory : public AddGateFactory
 {
 	virtual ~MultiplexGateFactory() {}
 	
 	//Creates a gate
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
-		return new MultiplexGate();
+		return arena.own(new (arena) MultiplexGate());
 	}
 };
 
@@ -158,6 +177,14 @@ struct TimerGate : public Gate
 			outputs[i]->write(time);
 		}
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		state.push_back(time);
+		state.push_back(incr);
+		state.push_back(reset);
+		return OP_TIMER;
+	}
 };
 struct TimerGateFactory : public GateFactory
 {
@@ -168,13 +195,13 @@ struct TimerGateFactory : public GateFactory
 	}
 	
 	//Generates a random vector of parameters
-	virtual std::vector<float> generateParams()
+	virtual std::vector<float> generateParams(Common::Random& rng)
 	{
 		vector<float> res(3);
 		
-		res[2] = drand48() * 1e8;
-		res[1] = res[2] / drand48() * 1e-8;
-		res[0] = res[2] * drand48();
+		res[2] = rng.uniform() * 1e8;
+		res[1] = res[2] / rng.uniform() * 1e-8;
+		res[0] = res[2] * rng.uniform();
 		
 		return res;
 	}
@@ -190,10 +217,10 @@ struct TimerGateFactory : public GateFactory
 	}
 	
 	//Creates a gate
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
 		assert(params.size() == 3);
-		return new TimerGate(params[0], params[1], params[2]);
+		return arena.own(new (arena) TimerGate(params[0], params[1], params[2]));
 	}
 
 };
@@ -211,6 +238,12 @@ struct ConstantGate : public Gate
 		for(int i=0; i<(int)outputs.size(); i++)
 			outputs[i]->write(val);
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		state.push_back(val);
+		return OP_CONST;
+	}
 };
 struct ConstantGateFactory : public GateFactory
 {
@@ -221,11 +254,11 @@ struct ConstantGateFactory : public GateFactory
 	}
 	
 	//Generates a random vector of parameters
-	virtual std::vector<float> generateParams()
+	virtual std::vector<float> generateParams(Common::Random& rng)
 	{
 		vector<float> res(1);
 		
-		res[0] = (drand48() + drand48() + drand48() + drand48() - 2.)*20.;
+		res[0] = (rng.uniform() + rng.uniform() + rng.uniform() + rng.uniform() - 2.)*20.;
 		
 		return res;
 	}
@@ -237,10 +270,10 @@ struct ConstantGateFactory : public GateFactory
 	}
 	
 	//Creates a gate
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
 		assert(params.size() == 1);
-		return new ConstantGate(params[0]);
+		return arena.own(new (arena) ConstantGate(params[0]));
 	}
 
 };
@@ -258,6 +291,14 @@ struct SineGate : public Gate
 		for(int i=0; i<(int)inputs.size(); i++)
 			write(i, ampl * sin(read(i)*freq + phase));
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		state.push_back(freq);
+		state.push_back(ampl);
+		state.push_back(phase);
+		return OP_SINE;
+	}
 };
 struct SineGateFactory : public GateFactory
 {
@@ -268,13 +309,13 @@ struct SineGateFactory : public GateFactory
 	}
 	
 	//Generates a random vector of parameters
-	virtual std::vector<float> generateParams()
+	virtual std::vector<float> generateParams(Common::Random& rng)
 	{
 		vector<float> res(3);
 		
-		res[0] = (drand48() + drand48() + drand48() + drand48() - 2.) * 10.;
-		res[1] = (drand48() + drand48() + drand48() + drand48() - 2.) * 1e3;
-		res[2] = drand48() * M_PI;
+		res[0] = (rng.uniform() + rng.uniform() + rng.uniform() + rng.uniform() - 2.) * 10.;
+		res[1] = (rng.uniform() + rng.uniform() + rng.uniform() + rng.uniform() - 2.) * 1e3;
+		res[2] = rng.uniform() * M_PI;
 		
 		return res;
 	}
@@ -286,10 +327,10 @@ struct SineGateFactory : public GateFactory
 	}
 	
 	//Creates a gate
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
 		assert(params.size() == 3);
-		return new SineGate(params[0], params[1], params[2]);
+		return arena.own(new (arena) SineGate(params[0], params[1], params[2]));
 	}
 
 };
@@ -305,13 +346,18 @@ struct ExpGate : public Gate
 		for(int i=0; i<(int)inputs.size(); i++)
 			write(i, exp(read(i)));
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		return OP_EXP;
+	}
 };
 struct ExpGateFactory : public AddGateFactory
 {
 	//Creates a gate
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
-		return new ExpGate();
+		return arena.own(new (arena) ExpGate());
 	}
 };
 
@@ -336,13 +382,18 @@ struct LogGate : public Gate
 			}
 		}
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		return OP_LOG;
+	}
 };
 struct LogGateFactory : public AddGateFactory
 {
 	//Creates a gate
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
-		return new LogGate();
+		return arena.own(new (arena) LogGate());
 	}
 };
 
@@ -366,12 +417,17 @@ struct RecipGate : public Gate
 			}
 		}
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		return OP_RECIP;
+	}
 };
 struct RecipGateFactory : public AddGateFactory
 {
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
-		return new RecipGate();
+		return arena.own(new (arena) RecipGate());
 	}
 };
 
@@ -386,12 +442,17 @@ struct NegGate : public Gate
 		for(int i=0; i<(int)inputs.size(); i++)
 			write(i, -read(i));
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		return OP_NEG;
+	}
 };
 struct NegGateFactory : public AddGateFactory
 {
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
-		return new NegGate();
+		return arena.own(new (arena) NegGate());
 	}
 };
 
@@ -405,12 +466,17 @@ struct TanGate : public Gate
 		for(int i=0; i<(int)inputs.size(); i++)
 			write(i, tan(read(i)));
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		return OP_TAN;
+	}
 };
 struct TanGateFactory : public AddGateFactory
 {
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
-		return new TanGate();
+		return arena.own(new (arena) TanGate());
 	}
 };
 
@@ -423,12 +489,17 @@ struct ATanGate : public Gate
 		for(int i=0; i<(int)inputs.size(); i++)
 			write(i, atan(read(i)));
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		return OP_ATAN;
+	}
 };
 struct ATanGateFactory : public AddGateFactory
 {
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
-		return new ATanGate();
+		return arena.own(new (arena) ATanGate());
 	}
 };
 
@@ -444,12 +515,17 @@ struct MaxGate : public Gate
 			m = max(m, read(i));
 		write(0, m);
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		return OP_MAX;
+	}
 };
 struct MaxGateFactory : public AddGateFactory
 {
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
-		return new MaxGate();
+		return arena.own(new (arena) MaxGate());
 	}
 };
 
@@ -464,12 +540,17 @@ struct MinGate : public Gate
 			m = min(m, read(i));
 		write(0, m);
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		return OP_MIN;
+	}
 };
 struct MinGateFactory : public AddGateFactory
 {
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
-		return new MinGate();
+		return arena.own(new (arena) MinGate());
 	}
 };
 
@@ -485,12 +566,17 @@ struct IfGate : public Gate
 		else
 			write(0, read(2));
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		return OP_IF;
+	}
 };
 struct IfGateFactory : public AddGateFactory
 {
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
-		return new IfGate();
+		return arena.own(new (arena) IfGate());
 	}
 };
 
@@ -507,37 +593,602 @@ struct MemoryGate : public Gate
 			memory = read(1);
 		write(0, memory);
 	}
+	
+	virtual int compile(std::vector<float>& state)
+	{
+		state.push_back(memory);
+		return OP_MEM;
+	}
 };
 struct MemoryGateFactory : public AddGateFactory
 {
-	virtual Gate* createGate(std::vector<float> params)
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena)
 	{
-		return new MemoryGate();
+		return arena.own(new (arena) MemoryGate());
 	}
 };
 
 
+static const char* op_names[NUM_GATE_OPS] =
+{
+	"extern", "add", "mul", "multiplex", "timer", "const", "sine", "exp",
+	"log", "recip", "negate", "tan", "atan", "max", "min", "if", "mem"
+};
+
+const char* opName(int code)
+{
+	if(code < 0 || code >= NUM_GATE_OPS)
+		return "unknown";
+	return op_names[code];
+}
+
+int fanBucket(int count)
+{
+	int b = 0;
+	for(int top=0; b<FAN_BUCKETS-1 && count>top; top=top ? 2*top : 1)
+		b++;
+	return b;
+}
+
+//Cost of the two clock reads around each profiled op, measured once
+static double clock_overhead()
+{
+	static double overhead = -1.;
+	if(overhead < 0.)
+	{
+		const int N = 10000;
+		double sum = 0.;
+		for(int i=0; i<N; i++)
+		{
+			double t0 = Common::fine_time();
+			sum += Common::fine_time() - t0;
+		}
+		overhead = sum / N;
+	}
+	return overhead;
+}
+
+void CircuitProfile::clear()
+{
+	circuits = gates = wires = ticks = 0;
+	for(int i=0; i<FAN_BUCKETS; i++)
+		fan_in[i] = fan_out[i] = 0;
+	for(int i=0; i<NUM_GATE_OPS; i++)
+	{
+		evals[i] = 0;
+		time[i] = 0.;
+	}
+}
+
+void CircuitProfile::add(const CircuitProfile& other)
+{
+	circuits	+= other.circuits;
+	gates		+= other.gates;
+	wires		+= other.wires;
+	ticks		+= other.ticks;
+	for(int i=0; i<FAN_BUCKETS; i++)
+	{
+		fan_in[i]	+= other.fan_in[i];
+		fan_out[i]	+= other.fan_out[i];
+	}
+	for(int i=0; i<NUM_GATE_OPS; i++)
+	{
+		evals[i]	+= other.evals[i];
+		time[i]		+= other.time[i];
+	}
+}
+
+double CircuitProfile::seconds(int code) const
+{
+	double t = time[code] - evals[code] * clock_overhead();
+	return t > 0. ? t : 0.;
+}
+
+double CircuitProfile::total_seconds() const
+{
+	double t = 0.;
+	for(int i=0; i<NUM_GATE_OPS; i++)
+		t += seconds(i);
+	return t;
+}
+
+long CircuitProfile::total_evals() const
+{
+	long n = 0;
+	for(int i=0; i<NUM_GATE_OPS; i++)
+		n += evals[i];
+	return n;
+}
+
+//Looks up the value slot for a wire, allocating a new one if needed
+static int wire_slot(Wire* w, map<Wire*, int>& wire_ids, vector<float>& values)
+{
+	map<Wire*, int>::iterator it = wire_ids.find(w);
+	if(it != wire_ids.end())
+		return it->second;
+	
+	int id = values.size();
+	values.push_back(w->read());
+	wire_ids[w] = id;
+	return id;
+}
+
+//Lowers a gate and appends it to the program
+void CompiledCircuit::append(Gate* gate, map<Wire*, int>& wire_ids)
+{
+	Op op;
+	op.gate		= gate;
+	op.state	= state.size();
+	op.code		= gate->compile(state);
+	
+	op.in		= args.size();
+	op.num_in	= gate->inputs.size();
+	for(int i=0; i<op.num_in; i++)
+		args.push_back(wire_slot(gate->inputs[i], wire_ids, values));
+	
+	op.out		= args.size();
+	op.num_out	= gate->outputs.size();
+	for(int i=0; i<op.num_out; i++)
+		args.push_back(wire_slot(gate->outputs[i], wire_ids, values));
+	
+	ops.push_back(op);
+}
+
+//Kahn's algorithm over the op graph, an edge runs from each op writing a
+//wire to each op reading it.  Ready ops go in the order they became ready,
+//which keeps the old order where it already was a valid one.
+void CompiledCircuit::schedule()
+{
+	int n = ops.size();
+	int num_slots = values.size();
+	
+	//Writers and readers of every slot, as index lists
+	vector<int> writer_start(num_slots+1, 0), reader_start(num_slots+1, 0);
+	for(int i=0; i<n; i++)
+	{
+		const Op& op = ops[i];
+		for(int j=0; j<op.num_out; j++)
+			writer_start[args[op.out+j]+1]++;
+		for(int j=0; j<op.num_in; j++)
+			reader_start[args[op.in+j]+1]++;
+	}
+	for(int s=0; s<num_slots; s++)
+	{
+		writer_start[s+1] += writer_start[s];
+		reader_start[s+1] += reader_start[s];
+	}
+	vector<int> writers(writer_start[num_slots]), readers(reader_start[num_slots]);
+	vector<int> wfill(writer_start.begin(), writer_start.end()-1);
+	vector<int> rfill(reader_start.begin(), reader_start.end()-1);
+	for(int i=0; i<n; i++)
+	{
+		const Op& op = ops[i];
+		for(int j=0; j<op.num_out; j++)
+			writers[wfill[args[op.out+j]]++] = i;
+		for(int j=0; j<op.num_in; j++)
+			readers[rfill[args[op.in+j]]++] = i;
+	}
+	
+	//An op waits on every writer of every wire it reads, except itself
+	vector<int> waiting(n, 0);
+	for(int i=0; i<n; i++)
+	{
+		const Op& op = ops[i];
+		for(int j=0; j<op.num_in; j++)
+		{
+			int s = args[op.in+j];
+			for(int k=writer_start[s]; k<writer_start[s+1]; k++)
+				waiting[i] += writers[k] != i;
+		}
+	}
+	
+	vector<int> order;
+	order.reserve(n);
+	vector<bool> placed(n, false);
+	int head = 0, next_cut = 0;
+	for(int i=0; i<n; i++)
+	{
+		if(waiting[i] == 0)
+		{
+			order.push_back(i);
+			placed[i] = true;
+		}
+	}
+	
+	while((int)order.size() < n)
+	{
+		//Everything left waits on a cycle, cut it at the first op
+		if(head == (int)order.size())
+		{
+			while(placed[next_cut])
+				next_cut++;
+			order.push_back(next_cut);
+			placed[next_cut] = true;
+		}
+		
+		const Op& op = ops[order[head++]];
+		for(int j=0; j<op.num_out; j++)
+		{
+			int s = args[op.out+j];
+			for(int k=reader_start[s]; k<reader_start[s+1]; k++)
+			{
+				int r = readers[k];
+				if(!placed[r] && --waiting[r] == 0)
+				{
+					order.push_back(r);
+					placed[r] = true;
+				}
+			}
+		}
+	}
+	
+	//An input whose wire is written at or after the reader's turn carries last
+	//tick's value
+	vector<int> position(n);
+	for(int i=0; i<n; i++)
+		position[order[i]] = i;
+	num_delays = 0;
+	for(int i=0; i<n; i++)
+	{
+		const Op& op = ops[i];
+		for(int j=0; j<op.num_in; j++)
+		{
+			int s = args[op.in+j];
+			for(int k=writer_start[s]; k<writer_start[s+1]; k++)
+			{
+				if(position[writers[k]] >= position[i])
+				{
+					num_delays++;
+					break;
+				}
+			}
+		}
+	}
+	
+	//Lay the program, its arguments and the wires out in the new order
+	vector<Op> new_ops(n);
+	vector<int> new_args;
+	new_args.reserve(args.size());
+	vector<int> slot_map(num_slots, -1);
+	vector<float> new_values;
+	new_values.reserve(num_slots);
+	for(int i=0; i<n; i++)
+	{
+		Op op = ops[order[i]];
+		int in = op.in, out = op.out;
+		
+		op.in = new_args.size();
+		for(int j=0; j<op.num_in; j++)
+			new_args.push_back(args[in+j]);
+		op.out = new_args.size();
+		for(int j=0; j<op.num_out; j++)
+			new_args.push_back(args[out+j]);
+		
+		for(int j=op.in; j<(int)new_args.size(); j++)
+		{
+			int& s = new_args[j];
+			if(slot_map[s] < 0)
+			{
+				slot_map[s] = new_values.size();
+				new_values.push_back(values[s]);
+			}
+			s = slot_map[s];
+		}
+		new_ops[i] = op;
+	}
+	
+	ops.swap(new_ops);
+	args.swap(new_args);
+	values.swap(new_values);
+	settle(settle_passes);
+}
+
+void CompiledCircuit::settle(int passes)
+{
+	settle_passes = passes;
+	settle_ops.clear();
+	if(passes <= 0)
+		return;
+	
+	for(int i=0; i<(int)ops.size(); i++)
+	{
+		//A sensor has nothing to settle, and calling it again could move
+		//its own clock on
+		int code = ops[i].code;
+		if(code == OP_EXTERN && ops[i].num_in == 0)
+			continue;
+		if(code != OP_TIMER && code != OP_MULTIPLEX && code != OP_MEM)
+			settle_ops.push_back(ops[i]);
+	}
+}
+
+void CompiledCircuit::measure(CircuitProfile& out) const
+{
+	out.circuits++;
+	out.gates += ops.size();
+	out.wires += values.size();
+	for(int i=0; i<(int)ops.size(); i++)
+	{
+		out.fan_in[fanBucket(ops[i].num_in)]++;
+		out.fan_out[fanBucket(ops[i].num_out)]++;
+	}
+}
+
+//Same as Gate::read(), but on the value buffer
+static inline float read_arg(const float* v, const int* in, int num_in, int x)
+{
+	if(x >= num_in)
+		return 0.;
+	return v[in[x]];
+}
+
+void CompiledCircuit::update()
+{
+	if(profile != NULL)
+		profile->ticks++;
+	
+	execute(ops);
+	
+	for(int i=0; i<settle_passes; i++)
+	{
+		last_values = values;
+		execute(settle_ops);
+		if(values == last_values)
+			break;
+	}
+}
+
+void CompiledCircuit::execute(const vector<Op>& program)
+{
+	if(program.empty())
+		return;
+	
+	const Op* first = &program[0];
+	const Op* last = first + program.size();
+	if(profile == NULL)
+	{
+		run(first, last);
+		return;
+	}
+	
+	for(const Op* op=first; op<last; op++)
+	{
+		double t0 = Common::fine_time();
+		run(op, op+1);
+		profile->time[op->code] += Common::fine_time() - t0;
+		profile->evals[op->code]++;
+	}
+}
+
+//Runs the ops from first up to last.  Each case mirrors the update() method
+//of the matching gate exactly, so that the results agree bit for bit.
+void CompiledCircuit::run(const Op* first, const Op* last)
+{
+	float*		v	= values.empty() ? NULL : &values[0];
+	float*		st	= state.empty() ? NULL : &state[0];
+	const int*	a	= &args[0];
+	
+	for(const Op* p=first; p<last; p++)
+	{
+		const Op& op = *p;
+		const int* in = a + op.in;
+		const int* out = a + op.out;
+		
+		switch(op.code)
+		{
+			case OP_EXTERN:
+			{
+				Gate* g = op.gate;
+				for(int i=0; i<op.num_in; i++)
+					g->inputs[i]->write(v[in[i]]);
+				g->update();
+				for(int i=0; i<op.num_out; i++)
+					v[out[i]] = g->outputs[i]->read();
+			}
+			break;
+			
+			case OP_ADD:
+			{
+				float s = 0.;
+				for(int i=0; i<op.num_in; i++)
+					s += v[in[i]];
+				for(int j=0; j<op.num_out; j++)
+					v[out[j]] = s;
+			}
+			break;
+			
+			case OP_MUL:
+			{
+				float s = 1.;
+				for(int i=0; i<op.num_in; i++)
+					s *= v[in[i]];
+				for(int j=0; j<op.num_out; j++)
+					v[out[j]] = s;
+			}
+			break;
+			
+			case OP_MULTIPLEX:
+			{
+				float s = 0.;
+				if(op.num_in > 0)
+				{
+					//Counter is stored as a float, exact for any sane fan in
+					int count = ((int)st[op.state] + 1) % op.num_in;
+					st[op.state] = count;
+					s = v[in[count]];
+				}
+				for(int j=0; j<op.num_out; j++)
+					v[out[j]] = s;
+			}
+			break;
+			
+			case OP_TIMER:
+			{
+				float&	time	= st[op.state];
+				float	incr	= st[op.state+1],
+						reset	= st[op.state+2];
+				
+				time += incr;
+				while(time >= reset)
+					time -= reset;
+				
+				for(int j=0; j<op.num_out; j++)
+					v[out[j]] = time;
+			}
+			break;
+			
+			case OP_CONST:
+				for(int j=0; j<op.num_out; j++)
+					v[out[j]] = st[op.state];
+			break;
+			
+			case OP_SINE:
+			{
+				float	freq	= st[op.state],
+						ampl	= st[op.state+1],
+						phase	= st[op.state+2];
+				int m = min(op.num_in, op.num_out);
+				for(int i=0; i<m; i++)
+					v[out[i]] = ampl * sin(v[in[i]]*freq + phase);
+			}
+			break;
+			
+			case OP_EXP:
+				for(int i=0; i<min(op.num_in, op.num_out); i++)
+					v[out[i]] = exp(v[in[i]]);
+			break;
+			
+			case OP_LOG:
+				for(int i=0; i<min(op.num_in, op.num_out); i++)
+				{
+					float x = v[in[i]];
+					if(x <= 1e-6)
+						v[out[i]] = 0.;
+					else
+						v[out[i]] = log(x);
+				}
+			break;
+			
+			case OP_RECIP:
+				for(int i=0; i<min(op.num_in, op.num_out); i++)
+				{
+					float x = v[in[i]];
+					if(abs(x) <= 1e-6)
+						v[out[i]] = 0.;
+					else
+						v[out[i]] = 1./x;
+				}
+			break;
+			
+			case OP_NEG:
+				for(int i=0; i<min(op.num_in, op.num_out); i++)
+					v[out[i]] = -v[in[i]];
+			break;
+			
+			case OP_TAN:
+				for(int i=0; i<min(op.num_in, op.num_out); i++)
+					v[out[i]] = tan(v[in[i]]);
+			break;
+			
+			case OP_ATAN:
+				for(int i=0; i<min(op.num_in, op.num_out); i++)
+					v[out[i]] = atan(v[in[i]]);
+			break;
+			
+			case OP_MAX:
+			{
+				float m = -1e20;
+				for(int i=0; i<op.num_in; i++)
+					m = max(m, v[in[i]]);
+				if(op.num_out > 0)
+					v[out[0]] = m;
+			}
+			break;
+			
+			case OP_MIN:
+			{
+				float m = 1e20;
+				for(int i=0; i<op.num_in; i++)
+					m = min(m, v[in[i]]);
+				if(op.num_out > 0)
+					v[out[0]] = m;
+			}
+			break;
+			
+			case OP_IF:
+				if(op.num_out > 0)
+				{
+					if(read_arg(v, in, op.num_in, 0) > 0.f)
+						v[out[0]] = read_arg(v, in, op.num_in, 1);
+					else
+						v[out[0]] = read_arg(v, in, op.num_in, 2);
+				}
+			break;
+			
+			case OP_MEM:
+				if(read_arg(v, in, op.num_in, 0) > 0.)
+					st[op.state] = read_arg(v, in, op.num_in, 1);
+				if(op.num_out > 0)
+					v[out[0]] = st[op.state];
+			break;
+			
+			default: assert(false);
+		}
+	}
+}
+
+
 
 //GateFactory registration
-static map<string, GateFactory*> factories;
-static vector<string>			 gate_names;
-void registerGateFactory(const std::string& name, GateFactory* factory)
+static vector<GateFactory*>	factories;
+static vector<string>		gate_names;
+static map<string, int>		gate_ids;
+
+int registerGateFactory(const std::string& name, GateFactory* factory)
 {
-	factories[name] = factory;
+	assert(gate_ids.find(name) == gate_ids.end());
+	int id = factories.size();
+	factories.push_back(factory);
 	gate_names.push_back(name);
+	gate_ids[name] = id;
+	return id;
+}
+
+int numGateTypes()
+{
+	return factories.size();
+}
+
+int gateId(const std::string& name)
+{
+	string lower(name);
+	for(int i=0; i<(int)lower.size(); i++)
+		lower[i] = tolower(lower[i]);
+	
+	map<string, int>::const_iterator it = gate_ids.find(lower);
+	if(it == gate_ids.end())
+		return UNKNOWN_GATE;
+	return it->second;
+}
+
+const std::string& gateName(int id)
+{
+	static const string unknown("unknown");
+	if(id < 0 || id >= (int)gate_names.size())
+		return unknown;
+	return gate_names[id];
 }
 
-GateFactory* getFactory(const std::string& name)
+GateFactory* getFactory(int id)
 {
-	if(name.size() == 0)
-		return factories[0];
-	assert(factories.find(name) != factories.end());
-	return factories[name];
+	if(id < 0 || id >= (int)factories.size())
+		return NULL;
+	return factories[id];
 }
 
-string randomGateName()
+int randomGateId(Common::Random& rng)
 {
-	return gate_names[rand() % gate_names.size()];
+	return rng.below(factories.size());
 }
 
 
@@ -5,9 +5,39 @@
 #include <vector>
 #include <string>
 
+#include "common/arena.h"
+#include "common/random.h"
+
 namespace Game
 {
 
+//Op codes used by the compiled circuit evaluator
+enum GateOp
+{
+	OP_EXTERN = 0,		//Not lowered, calls back into the Gate object
+	OP_ADD,
+	OP_MUL,
+	OP_MULTIPLEX,
+	OP_TIMER,
+	OP_CONST,
+	OP_SINE,
+	OP_EXP,
+	OP_LOG,
+	OP_RECIP,
+	OP_NEG,
+	OP_TAN,
+	OP_ATAN,
+	OP_MAX,
+	OP_MIN,
+	OP_IF,
+	OP_MEM,
+	
+	NUM_GATE_OPS
+};
+
+//Short name of an op code, for reports
+extern const char* opName(int code);
+
 //A wire connecting two gates
 struct Wire
 {
@@ -37,6 +67,11 @@ struct Gate
 	//Updates the logic gate
 	virtual void update() = 0;
 	
+	//Lowers the gate for the compiled evaluator.  Appends any internal state to
+	//the state vector and returns the op code.  Gates which talk to the physics
+	//engine are left as OP_EXTERN and get called back through update().
+	virtual int compile(std::vector<float>& state) { return OP_EXTERN; }
+	
 	float read(int x)
 	{
 		if(x < 0 || x >= (int)inputs.size())
@@ -64,15 +99,15 @@ struct GateFactory
 	virtual int numParams() = 0;
 	
 	//Generates a random vector of parameters
-	virtual std::vector<float> generateParams() = 0;
+	virtual std::vector<float> generateParams(Common::Random& rng) = 0;
 	
-	virtual void perturbParams(std::vector<float>& params);
+	virtual void perturbParams(std::vector<float>& params, Common::Random& rng);
 	
 	//Normalizes the parameter vector
 	virtual void normalize(std::vector<float>& params) = 0;
 	
-	//Creates a gate
-	virtual Gate* createGate(std::vector<float> params) = 0;
+	//Creates a gate in the arena, which owns it from then on
+	virtual Gate* createGate(const std::vector<float>& params, Common::Arena& arena) = 0;
 	
 };
 
@@ -92,10 +127,114 @@ struct Circuit
 	void update();
 };
 
+//Gates are binned by how many wires go in or out of them: 0, 1, 2, 3-4, 5-8,
+//9-16, 17-32 and 33 or more
+const int FAN_BUCKETS = 8;
+extern int fanBucket(int count);
+
+//What a set of compiled circuits cost to run, by op code, and the shape of
+//their wiring.  Plain data, so it can be added up and copied into records.
+struct CircuitProfile
+{
+	CircuitProfile() { clear(); }
+	
+	long	circuits;
+	long	gates, wires;
+	long	fan_in[FAN_BUCKETS];	//Gates by number of input wires
+	long	fan_out[FAN_BUCKETS];	//Gates by number of output wires
+	
+	long	ticks;
+	long	evals[NUM_GATE_OPS];
+	double	time[NUM_GATE_OPS];		//Seconds, with the clock still in
+	
+	void clear();
+	void add(const CircuitProfile& other);
+	
+	//Time spent in gates of one type, less the cost of reading the clock
+	double seconds(int code) const;
+	double total_seconds() const;
+	long total_evals() const;
+};
+
+//A compiled circuit is a flattened copy of a gate network.  Wire values live in
+//one dense buffer and the gates are lowered to a flat op code array, which is
+//run in the same order as the original Gate objects unless schedule() is
+//called.
+struct CompiledCircuit
+{
+	CompiledCircuit() : num_delays(0), profile(NULL), settle_passes(0) {}
+
+	struct Op
+	{
+		int		code;
+		int		in, num_in;		//Input wire indices are args[in .. in+num_in)
+		int		out, num_out;	//Output wire indices are args[out .. out+num_out)
+		int		state;			//Offset of internal gate state
+		Gate*	gate;			//Source gate, only used by OP_EXTERN
+	};
+
+	std::vector<Op>		ops;
+	std::vector<int>	args;
+	std::vector<float>	values;
+	std::vector<float>	state;
+	
+	//Number of gate inputs which still see the previous tick's value after
+	//schedule() has run, one per input on a cycle
+	int					num_delays;
+	
+	//If set, every op is counted and timed into it as it runs.  This costs
+	//two clock reads per gate, so leave it NULL outside of profiling.
+	CircuitProfile*		profile;
+	
+	//Appends a gate to the end of the program.  wire_ids maps each wire to its
+	//slot in the value buffer, new wires are allocated as they are found.
+	void append(Gate* gate, std::map<Wire*, int>& wire_ids);
+	
+	//Reorders the program so that every wire is written before it is read,
+	//and renumbers the wires in the order the program first touches them.
+	//A cycle is cut at its op which came first in the old order, so that op
+	//reads the previous tick's value of the wires the cycle feeds back.
+	//Call once the last gate has been appended.
+	void schedule();
+	
+	//Up to passes extra runs of the program per tick, skipping the gates
+	//which keep state (timer, multiplex, mem).  Signals which go round a
+	//cycle settle within the tick instead of over several, the passes stop
+	//early once no wire changes.  Effectors are called again with the
+	//settled signal, sensors are not since they have no inputs.
+	void settle(int passes);
+	
+	//Runs one tick of the circuit
+	void update();
+	
+	//Adds the size and fan in/out of the gates to out
+	void measure(CircuitProfile& out) const;
+
+private:
+	int					settle_passes;
+	std::vector<Op>		settle_ops;
+	std::vector<float>	last_values;
+	
+	//Runs one program, op by op under the clock if profiled
+	void execute(const std::vector<Op>& program);
+	void run(const Op* first, const Op* last);
+};
+
+//Gate types are interned to dense ids when their factory is registered, so
+//building a circuit is just an array lookup.  Names are only used to read and
+//write genotypes.
+const int UNKNOWN_GATE = -1;
+
+extern int registerGateFactory(const std::string& name, GateFactory* factory);
+extern int numGateTypes();
+
+//Case insensitive, returns UNKNOWN_GATE if there is no such gate
+extern int gateId(const std::string& name);
+extern const std::string& gateName(int id);
 
-extern void registerGateFactory(const std::string& name, GateFactory* factory);
-extern GateFactory* getFactory(const std::string& name);
-extern std::string randomGateName();
+//Returns NULL for an invalid id
+extern GateFactory* getFactory(int id);
+extern int randomGateId(Common::Random& rng);
 
 
 
@@ -1,10 +1,14 @@
 #include "common/sys_includes.h"
 #include "common/physics.h"
+#include "common/timer.h"
 
 #include "project/creature.h"
 
 #include <iostream>
 #include <vector>
+#include <map>
+#include <set>
+#include <cmath>
 
 using namespace std;
 using namespace Common;
@@ -12,10 +16,18 @@ using namespace Common;
 namespace Game
 {
 
+bool	compile_circuits = true;
+bool	schedule_circuits = false;
+int		settle_passes = 0;
+bool	prune_circuits = true;
+
+#ifndef HEADLESS
 GLint	shape_lists;
+#endif
 
 void init_creatures()
 {
+#ifndef HEADLESS
 	shape_lists = glGenLists(3);
 	
 	//Generate box list
@@ -84,6 +96,7 @@ void init_creatures()
 		//TODO: Capsule drawing
 	glEnd();
 	glEndList();
+#endif
 }
 
 //Retrieves information about relative joint information
@@ -164,7 +177,87 @@ static NxCCDSkeleton* CreateCCDSkeleton (NxVec3 size)
 	stm.points = points;
 	stm.triangles = triangles;
 	stm.flags |= NX_MF_FLIPNORMALS;
-	return sdk->createCCDSkeleton(stm);
+	
+	lock_sdk();
+	NxCCDSkeleton* res = sdk->createCCDSkeleton(stm);
+	unlock_sdk();
+	return res;
+}
+
+//Skeletons come in size classes SKELETON_STEPS to a doubling
+const int SKELETON_STEPS = 4;
+
+struct SkeletonClass
+{
+	int x, y, z;
+	
+	bool operator<(const SkeletonClass& o) const
+	{
+		if(x != o.x) return x < o.x;
+		if(y != o.y) return y < o.y;
+		return z < o.z;
+	}
+};
+
+static map<SkeletonClass, NxCCDSkeleton*>	skeletons;
+static PoolStats							skeleton_pool;
+
+static int size_class(float x)
+{
+	return (int)floor(log(x) / log(2.) * SKELETON_STEPS);
+}
+
+static float class_size(int c)
+{
+	return pow(2., (double)c / SKELETON_STEPS);
+}
+
+//Rounds the size down to its class, so the skeleton never pokes out of
+//the box it was made for
+static NxCCDSkeleton* cached_skeleton(const NxVec3& size)
+{
+	SkeletonClass key = { size_class(size.x), size_class(size.y), size_class(size.z) };
+	
+	double t0 = wall_time();
+	lock_sdk();
+	map<SkeletonClass, NxCCDSkeleton*>::iterator it = skeletons.find(key);
+	NxCCDSkeleton* res = it == skeletons.end() ? NULL : it->second;
+	if(res != NULL)
+	{
+		skeleton_pool.reused++;
+		skeleton_pool.reuse_time += wall_time() - t0;
+	}
+	unlock_sdk();
+	if(res != NULL)
+		return res;
+	
+	res = CreateCCDSkeleton(NxVec3(class_size(key.x), class_size(key.y), class_size(key.z)));
+	
+	lock_sdk();
+	if(skeletons.find(key) == skeletons.end())
+	{
+		skeletons[key] = res;
+		skeleton_pool.created++;
+		skeleton_pool.create_time += wall_time() - t0;
+	}
+	else
+	{
+		//Another scene cooked the same class in the meantime
+		sdk->releaseCCDSkeleton(*res);
+		res = skeletons[key];
+		skeleton_pool.reused++;
+		skeleton_pool.reuse_time += wall_time() - t0;
+	}
+	unlock_sdk();
+	return res;
+}
+
+PoolStats skeleton_stats()
+{
+	lock_sdk();
+	PoolStats res = skeleton_pool;
+	unlock_sdk();
+	return res;
 }
 
 
@@ -180,33 +273,71 @@ void BodyPart::init_shape(NxShapeDesc* foo, const NxMat34& tpose)
 
 /*
 	NxBox box(pose.t, size*.6, pose.M);
-	if(scene->checkOverlapOBB(box))
+	if(owner->scene->checkOverlapOBB(box))
 	{
 		return;
 	}
 */
 	
-	NxBoxShapeDesc shape_desc;
-	shape_desc.dimensions = size;
-	shape_desc.ccdSkeleton = CreateCCDSkeleton(size*0.6f);
-	shape_desc.shapeFlags |= NX_SF_DYNAMIC_DYNAMIC_CCD; //Activate dynamic-dynamic CCD for 
-
-	// Create body
-	NxBodyDesc bodyDesc;
-	bodyDesc.angularDamping	= 0.5f;
-
-	//Set up parameters
-	NxActorDesc actorDesc;
-	actorDesc.shapes.pushBack(&shape_desc);
-	actorDesc.body			= &bodyDesc;
-	actorDesc.density		= 10.0f;
-	actorDesc.globalPose	= pose;
-	actorDesc.group			= owner->group;
+	const float density = 10.0f;
 	
-	//Create the actor
-	actor = scene->createActor(actorDesc);
-	if(actor == NULL)
-		return;
+	NxCCDSkeleton* ccd;
+	bool positive = size.x > 0. && size.y > 0. && size.z > 0.;
+	if(pool_objects && positive)
+		ccd = cached_skeleton(size*0.6f);
+	else
+		ccd = skeleton = CreateCCDSkeleton(size*0.6f);
+	
+	ActorPool* pool = actor_pool(owner->scene);
+	double t0 = wall_time();
+	
+	//Take over a parked actor if there is one.  Everything the descriptor
+	//below sets that a creature may have changed gets set again.  A part
+	//without a positive size goes through createActor(), which rejects it.
+	if(pool_objects && positive && (actor = unpark_actor(owner->scene)) != NULL)
+	{
+		NxBoxShape* box = actor->getShapes()[0]->isBox();
+		box->setDimensions(size);
+		box->setCCDSkeleton(ccd);
+		box->setGroup(owner->collision_group);
+		actor->updateMassFromShapes(density, 0);
+		actor->setGlobalPose(pose);
+		actor->setGroup(owner->group);
+		actor->clearActorFlag(NX_AF_DISABLE_COLLISION);
+		actor->clearBodyFlag(NX_BF_FROZEN);
+		actor->wakeUp();
+		
+		pool->stats.reused++;
+		pool->stats.reuse_time += wall_time() - t0;
+	}
+	else
+	{
+		NxBoxShapeDesc shape_desc;
+		shape_desc.dimensions = size;
+		shape_desc.ccdSkeleton = ccd;
+		shape_desc.group = owner->collision_group;
+		shape_desc.shapeFlags |= NX_SF_DYNAMIC_DYNAMIC_CCD; //Activate dynamic-dynamic CCD for 
+	
+		// Create body
+		NxBodyDesc bodyDesc;
+		bodyDesc.angularDamping	= 0.5f;
+	
+		//Set up parameters
+		NxActorDesc actorDesc;
+		actorDesc.shapes.pushBack(&shape_desc);
+		actorDesc.body			= &bodyDesc;
+		actorDesc.density		= density;
+		actorDesc.globalPose	= pose;
+		actorDesc.group			= owner->group;
+		
+		//Create the actor
+		actor = owner->scene->createActor(actorDesc);
+		if(actor == NULL)
+			return;
+		
+		pool->stats.created++;
+		pool->stats.create_time += wall_time() - t0;
+	}
 		
 	actor->userData = (void*)this;
 	
@@ -247,54 +378,79 @@ BodyPart::BodyPart(
 }
 
 
+//Detached constructor
+BodyPart::BodyPart(
+	Creature*			owner_,
+	const NxVec3&		size_)
+		: color(0,0,0), actor(NULL), owner(owner_), skeleton(NULL), shape(BODY_BOX), size(size_)
+{
+}
+
+
 //Body part destructor
 BodyPart::~BodyPart()
 {
 	//Need to clean up joints first
 	for(int i=0; i<(int)joints.size(); i++)
-		scene->releaseJoint(*joints[i]);
+		owner->scene->releaseJoint(*joints[i]);
 		
-	for(int i=0; i<(int)controls.size(); i++)
-		delete controls[i];
-	for(int i=0; i<(int)effectors.size(); i++)
-		delete effectors[i];
-	for(int i=0; i<(int)sensors.size(); i++)
-		delete sensors[i];
-	for(int i=0; i<(int)wires.size(); i++)
-		delete wires[i];
-
-	//Then release actor
+	//Then release actor.  One with its own skeleton can't be parked, the
+	//skeleton goes away with the part.
 	if(actor != NULL)
-		scene->releaseActor(*actor);
+	{
+		if(pool_objects && skeleton == NULL)
+			park_actor(owner->scene, actor);
+		else
+			owner->scene->releaseActor(*actor);
+	}
 
 	if(skeleton != NULL)
+	{
+		lock_sdk();
 		sdk->releaseCCDSkeleton(*skeleton);
+		unlock_sdk();
+	}
 }
 
 //Draws a body part
 void BodyPart::draw() const
 {
-	//Set up matrix
-	glPushMatrix();
-	float glMat[16];
-	actor->getGlobalPose().getColumnMajor44(glMat);	
-	glMultMatrixf(glMat);
+	snapshot().draw();
+}
+
+PartSnapshot BodyPart::snapshot() const
+{
+	PartSnapshot res;
+	actor->getGlobalPose().getColumnMajor44(res.pose);
+	res.color = color;
+	res.shape = shape;
 	
-	//Set appropriate scale
 	switch(shape)
 	{
 		case BODY_BOX:
-			glScalef(size.x, size.y, size.z);
+			res.scale = size;
 		break;
 		
 		case BODY_SPHERE:
-			glScalef(radius, radius, radius);
+			res.scale = NxVec3(radius, radius, radius);
 		break;
 		
 		case BODY_CAPSULE:
-			glScalef(radius, length, radius);
+			res.scale = NxVec3(radius, length, radius);
 		break;
-	}		
+	}
+	return res;
+}
+
+void PartSnapshot::draw() const
+{
+#ifndef HEADLESS
+	//Set up matrix
+	glPushMatrix();
+	glMultMatrixf(pose);
+	
+	//Set appropriate scale
+	glScalef(scale.x, scale.y, scale.z);
 	
 	//Set color
 	glColor3f(color.x, color.y, color.z);
@@ -303,6 +459,7 @@ void BodyPart::draw() const
 	glCallList(shape_lists + (int)shape);
 	
 	glPopMatrix();
+#endif
 }
 
 //Update each control
@@ -320,23 +477,34 @@ void BodyPart::attachPart(BodyPart* part, NxJoint* joint, float strength)
 {
 	limbs.push_back(part);
 	joints.push_back(joint);
-	effectors.push_back(new JointEffector(joint, strength));
-	sensors.push_back(new JointSensor(joint));
+	Arena& arena = owner->arena;
+	effectors.push_back(arena.own(new (arena) JointEffector(joint, strength)));
+	sensors.push_back(arena.own(new (arena) JointSensor(joint)));
 }
 
 
 //Acquire group
-Creature::Creature()
+Creature::Creature(NxScene* scene_, NxCollisionGroup collision_group_) :
+	circuit(NULL),
+	scene(scene_),
+	group(0),
+	collision_group(collision_group_)
 {
-	group = get_group();
+	if(scene != NULL)
+		group = get_group();
 }
 
 //Release stuff
 Creature::~Creature()
 {
+	delete circuit;
 	for(int i=0; i<(int)body.size(); i++)
-		delete body[i];
-	release_group(group);
+		release_part(body[i]);
+	
+	//Gates and wires go all at once
+	arena.reset();
+	if(scene != NULL)
+		release_group(group);
 }
 
 
@@ -350,9 +518,87 @@ void Creature::draw() const
 //Updates creature (incl. logic, contact sensors, etc.)
 void Creature::update()
 {
+	if(circuit != NULL)
+	{
+		circuit->update();
+		return;
+	}
+
 	for(int i=0; i<(int)body.size(); i++)
 		body[i]->update();
 }
 
+//Flattens the gates in the same order that BodyPart::update() visits them
+static void add_writers(const vector<Gate*>& gates, map<Wire*, Gate*>& writer)
+{
+	for(int i=0; i<(int)gates.size(); i++)
+	for(int j=0; j<(int)gates[i]->outputs.size(); j++)
+		writer[gates[i]->outputs[j]] = gates[i];
+}
+
+//Walks the wires back from the effectors.  Every wire has a single writer,
+//so whatever isn't reached can't move the creature.
+static void find_live_gates(const vector<BodyPart*>& body, set<Gate*>& live)
+{
+	map<Wire*, Gate*> writer;
+	vector<Gate*> stack;
+	for(int i=0; i<(int)body.size(); i++)
+	{
+		BodyPart* p = body[i];
+		add_writers(p->sensors, writer);
+		add_writers(p->controls, writer);
+		add_writers(p->effectors, writer);
+		for(int j=0; j<(int)p->effectors.size(); j++)
+		{
+			live.insert(p->effectors[j]);
+			stack.push_back(p->effectors[j]);
+		}
+	}
+	
+	while(!stack.empty())
+	{
+		Gate* g = stack.back();
+		stack.pop_back();
+		for(int i=0; i<(int)g->inputs.size(); i++)
+		{
+			map<Wire*, Gate*>::iterator w = writer.find(g->inputs[i]);
+			if(w != writer.end() && live.insert(w->second).second)
+				stack.push_back(w->second);
+		}
+	}
+}
+
+void Creature::compile()
+{
+	delete circuit;
+	circuit = new CompiledCircuit();
+	
+	set<Gate*> live;
+	if(prune_circuits)
+		find_live_gates(body, live);
+	
+	map<Wire*, int> wire_ids;
+	for(int i=0; i<(int)body.size(); i++)
+	{
+		BodyPart* p = body[i];
+		for(int j=0; j<(int)p->sensors.size(); j++)
+		{
+			if(!prune_circuits || live.count(p->sensors[j]))
+				circuit->append(p->sensors[j], wire_ids);
+		}
+		for(int j=0; j<(int)p->controls.size(); j++)
+		{
+			if(!prune_circuits || live.count(p->controls[j]))
+				circuit->append(p->controls[j], wire_ids);
+		}
+		for(int j=0; j<(int)p->effectors.size(); j++)
+			circuit->append(p->effectors[j], wire_ids);
+	}
+	
+	if(schedule_circuits)
+		circuit->schedule();
+	circuit->settle(settle_passes);
+}
+
 };
 
@@ -2,6 +2,8 @@
 #define CREATURE_H
 
 #include "common/sys_includes.h"
+#include "common/arena.h"
+#include "common/physics.h"
 #include "project/circuit.h"
 #include <vector>
 
@@ -12,6 +14,23 @@ using namespace std;
 
 extern void init_creatures();
 
+//If set, creatures are run through a compiled copy of their circuits
+extern bool compile_circuits;
+
+//If set, compiled circuits are put in dependency order, so that a signal
+//crosses any chain of gates in one tick instead of one gate a tick
+extern bool schedule_circuits;
+
+//Extra passes a compiled circuit may take each tick for feedback loops to settle
+extern int settle_passes;
+
+//If set, compiled circuits leave out the gates which can't reach an effector.
+//The effectors see the same values either way.
+extern bool prune_circuits;
+
+//CCD skeletons cooked and reused so far, over all scenes
+Common::PoolStats skeleton_stats();
+
 
 //A sensor is used to acquire input from the environment for the creature's control network
 struct JointSensor : Gate
@@ -51,6 +70,18 @@ enum BodyPartType
 	BODY_CAPSULE,
 };
 
+//What it takes to draw a body part, copied out of the scene so that one
+//thread can draw while another steps the simulation
+struct PartSnapshot
+{
+	float			pose[16];	//Column major
+	NxVec3			color;
+	BodyPartType	shape;
+	NxVec3			scale;		//Scale of the unit shape along each axis
+	
+	void draw() const;
+};
+
 //A creature body part, this is the abstract interface
 struct BodyPart
 {
@@ -76,12 +107,21 @@ struct BodyPart
 		float				radius_,
 		float				length_);
 
+	//Detached constructor, the part only carries a control circuit and has
+	//no physical actor (used for physics-free dry runs)
+	BodyPart(
+		struct Creature*	owner_,
+		const NxVec3&		size_);
+
 	//Virtual interfaces
 	~BodyPart();
 	
 	//Draws the actual body part
 	void draw() const;
 	
+	//Current pose and looks of the part, the actor must exist
+	PartSnapshot snapshot() const;
+	
 	//Updates internal state variables
 	void update();
 	
@@ -97,7 +137,7 @@ struct BodyPart
 	vector<BodyPart*>			limbs;	//Limbs
 	vector<NxJoint*>			joints;	//Joints
 	struct Creature*			owner;	//Creature which owns this part
-	NxCCDSkeleton*				skeleton;
+	NxCCDSkeleton*				skeleton;	//Only set if the part owns it
 	
 	//Shape parameters
 	BodyPartType				shape;
@@ -107,7 +147,8 @@ struct BodyPart
 		
 	//TODO: Add material properties
 	
-	//Local control circuit for this creature
+	//Local control circuit for this creature.  The gates and wires live in
+	//the owner's arena.
 	vector<Gate*>				controls;
 	vector<Gate*>				sensors;
 	vector<Gate*>				effectors;
@@ -122,8 +163,10 @@ private:
 //Creature data
 struct Creature
 {
-	//Constructor/destructor for creature
-	Creature();
+	//Constructor/destructor for creature.  Without a scene the creature
+	//is only a body graph and circuit (see prescreen.h), and doesn't take
+	//an actor group.
+	Creature(NxScene* scene_, NxCollisionGroup collision_group_ = 0);
 	~Creature();
 
 	//Draws the critter
@@ -132,14 +175,36 @@ struct Creature
 	//Updates the creature
 	void update();
 	
+	//Lowers the control network of every body part into a single compiled circuit
+	void compile();
+	
 	NxMat34 get_pose() { return root->get_pose(); }
 	
+	//Body parts, gates and wires are all placed in the arena.  Gates are owned
+	//by it, but parts are not: they are torn down in build order, so each
+	//joint goes before the actors it links.
+	Common::Arena		arena;
+	
+	//Tears down a part built with new (arena).  A part which didn't make it
+	//into the body leaves its gates and wires in the arena until the
+	//creature goes away.
+	void release_part(BodyPart* part) { part->~BodyPart(); }
+	
 	//Body information for the creature
 	BodyPart*			root;
 	vector<BodyPart*>	body;
 	
+	//Compiled control network, NULL if the creature is not compiled
+	CompiledCircuit*	circuit;
+	
+	//Scene the creature lives in
+	NxScene*			scene;
+	
 	//Actor group for this creature
 	NxActorGroup		group;
+	
+	//Collision group of every shape, see isolate_lanes()
+	NxCollisionGroup	collision_group;
 };
 
 };
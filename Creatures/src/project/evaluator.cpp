@@ -0,0 +1,370 @@
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <pthread.h>
+
+#include "common/sys_includes.h"
+#include "common/physics.h"
+#include "common/timer.h"
+
+#include "project/evaluator.h"
+
+using namespace std;
+using namespace Common;
+
+namespace Game
+{
+
+const float ParallelEvaluator::LANE_SPACING = 200.;
+
+//Spawn the workers, each one gets a private scene
+ParallelEvaluator::ParallelEvaluator(
+	int num_threads,
+	float round_time,
+	float rest_time,
+	float time_step_,
+	const TrialOptions& trials,
+	int num_lanes) :
+		time_step(time_step_),
+		telemetry(NULL),
+		profiling(false),
+		generation(0),
+		batch(NULL),
+		batch_jobs(NULL),
+		batch_stopped(NULL),
+		next_job(0),
+		jobs_done(0),
+		quit(false)
+{
+	//Check the arguments before any thread is running
+	if(num_lanes < 1 || num_lanes > MAX_LANES)
+		throw "Bad number of lanes";
+	FitnessTest* probe = createFitnessTest(trials, round_time, rest_time);
+	if(probe == NULL)
+		throw "Unknown fitness test";
+	delete probe;
+
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&work_ready, NULL);
+	pthread_cond_init(&work_done, NULL);
+
+	for(int i=0; i<num_threads; i++)
+	{
+		Worker* w = new Worker();
+		w->owner	= this;
+		w->index	= i;
+		w->running	= 0;
+		w->build_time	= 0.;
+		w->scene	= create_scene();
+		isolate_lanes(w->scene, num_lanes);
+		
+		//Lanes go in a row along the z axis
+		w->lanes.resize(num_lanes);
+		for(int j=0; j<num_lanes; j++)
+		{
+			Lane& l = w->lanes[j];
+			l.tester = createFitnessTest(trials, round_time, rest_time, w->scene);
+			l.tester->verbose			= false;
+			l.tester->origin			= NxVec3(0., 0., j * LANE_SPACING);
+			l.tester->collision_group	= lane_group(j, num_lanes);
+			l.job = -1;
+		}
+		
+		if(pthread_create(&w->thread, NULL, worker_main, w) != 0)
+		{
+			cout << "Failed to start evaluator thread" << endl;
+			for(int j=0; j<num_lanes; j++)
+				delete w->lanes[j].tester;
+			release_scene(w->scene);
+			delete w;
+			continue;
+		}
+		workers.push_back(w);
+	}
+	
+	assert(workers.size() > 0);
+}
+
+//Stop all the workers and release their scenes
+ParallelEvaluator::~ParallelEvaluator()
+{
+	pthread_mutex_lock(&lock);
+	quit = true;
+	pthread_cond_broadcast(&work_ready);
+	pthread_mutex_unlock(&lock);
+	
+	for(int i=0; i<(int)workers.size(); i++)
+	{
+		Worker* w = workers[i];
+		pthread_join(w->thread, NULL);
+		for(int j=0; j<(int)w->lanes.size(); j++)
+			delete w->lanes[j].tester;
+		release_scene(w->scene);
+		delete w;
+	}
+	
+	pthread_cond_destroy(&work_done);
+	pthread_cond_destroy(&work_ready);
+	pthread_mutex_destroy(&lock);
+}
+
+void ParallelEvaluator::set_threshold(double threshold)
+{
+	for(int i=0; i<(int)workers.size(); i++)
+	for(int j=0; j<(int)workers[i]->lanes.size(); j++)
+		workers[i]->lanes[j].tester->threshold = threshold;
+}
+
+int ParallelEvaluator::early_stops() const
+{
+	int n = 0;
+	for(int i=0; i<(int)workers.size(); i++)
+	for(int j=0; j<(int)workers[i]->lanes.size(); j++)
+		n += workers[i]->lanes[j].tester->early_stops;
+	return n;
+}
+
+PoolStats ParallelEvaluator::pool_stats() const
+{
+	PoolStats res;
+	for(int i=0; i<(int)workers.size(); i++)
+		res.add(actor_pool(workers[i]->scene)->stats);
+	return res;
+}
+
+double ParallelEvaluator::build_time() const
+{
+	double res = 0.;
+	for(int i=0; i<(int)workers.size(); i++)
+		res += workers[i]->build_time;
+	return res;
+}
+
+CircuitProfile ParallelEvaluator::take_circuit_profile()
+{
+	CircuitProfile res;
+	for(int i=0; i<(int)workers.size(); i++)
+	{
+		res.add(workers[i]->circuits);
+		workers[i]->circuits.clear();
+	}
+	return res;
+}
+
+void ParallelEvaluator::set_telemetry(Telemetry* t)
+{
+	assert(t == NULL || t->num_producers() >= (int)workers.size());
+	telemetry = t;
+}
+
+//Hand out the generation and wait for all results to come back
+void ParallelEvaluator::evaluate(vector< pair<float,Genotype> >& species)
+{
+	vector<int> jobs(species.size());
+	for(int i=0; i<(int)jobs.size(); i++)
+		jobs[i] = i;
+	evaluate(species, jobs);
+}
+
+void ParallelEvaluator::evaluate(
+	vector< pair<float,Genotype> >&	species,
+	const vector<int>&				jobs,
+	vector<char>*					stopped)
+{
+	if(stopped != NULL)
+		stopped->resize(species.size(), 0);
+	if(jobs.size() == 0)
+		return;
+
+	pthread_mutex_lock(&lock);
+	batch = &species;
+	batch_jobs = &jobs;
+	batch_stopped = stopped;
+	next_job = 0;
+	jobs_done = 0;
+	pthread_cond_broadcast(&work_ready);
+	
+	while(jobs_done < (int)jobs.size())
+		pthread_cond_wait(&work_done, &lock);
+	
+	batch = NULL;
+	batch_jobs = NULL;
+	batch_stopped = NULL;
+	pthread_mutex_unlock(&lock);
+}
+
+void* ParallelEvaluator::worker_main(void* data)
+{
+	Worker* w = (Worker*)data;
+	w->owner->run_worker(w);
+	return NULL;
+}
+
+//Worker loop: fill the idle lanes from the queue, run the scene until a
+//trial ends, report back.  While a lane is running the batch can't be
+//finished, so batch stays put until every lane is idle again.
+void ParallelEvaluator::run_worker(Worker* w)
+{
+	vector<Lane>& lanes = w->lanes;
+	vector<int> started, finished;
+
+	pthread_mutex_lock(&lock);
+	while(true)
+	{
+		if(w->running == 0)
+		{
+			while(!quit && (batch == NULL || next_job >= (int)batch_jobs->size()))
+				pthread_cond_wait(&work_ready, &lock);
+			if(quit)
+				break;
+		}
+		
+		started.clear();
+		for(int i=0; i<(int)lanes.size() && next_job < (int)batch_jobs->size(); i++)
+		{
+			if(lanes[i].job >= 0)
+				continue;
+			lanes[i].job = (*batch_jobs)[next_job++];
+			started.push_back(i);
+		}
+		vector< pair<float,Genotype> >& species = *batch;
+		pthread_mutex_unlock(&lock);
+		
+		for(int i=0; i<(int)started.size(); i++)
+		{
+			Lane& l = lanes[started[i]];
+			start_lane(w, l, species[l.job].second);
+		}
+		
+		finished.clear();
+		while(finished.size() == 0)
+			tick(w, finished);
+		
+		for(int i=0; i<(int)finished.size(); i++)
+		{
+			Lane& l = lanes[finished[i]];
+			if(telemetry != NULL)
+			{
+				l.record.total_time	= wall_time() - l.start;
+				l.record.fitness	= l.tester->fitness;
+				l.record.stopped	= l.tester->stopped;
+				w->circuits.add(l.record.circuit);
+				telemetry->trial(w->index, l.record);
+			}
+		}
+		
+		pthread_mutex_lock(&lock);
+		for(int i=0; i<(int)finished.size(); i++)
+		{
+			Lane& l = lanes[finished[i]];
+			species[l.job].first = l.tester->fitness;
+			if(batch_stopped != NULL)
+				(*batch_stopped)[l.job] = l.tester->stopped;
+			l.job = -1;
+			w->running--;
+			if(++jobs_done == (int)batch_jobs->size())
+				pthread_cond_signal(&work_done);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void ParallelEvaluator::start_lane(Worker* w, Lane& l, Genotype& genes)
+{
+	w->running++;
+	if(telemetry == NULL)
+	{
+		l.tester->start_test(genes);
+		return;
+	}
+	
+	TrialRecord& r = l.record;
+	r.generation	= generation;
+	r.species		= l.job;
+	r.ticks			= 0;
+	r.circuit_time	= r.physics_time = 0.;
+	r.actors		= r.joints = r.contacts = 0;
+	r.circuit.clear();
+	
+	l.start = wall_time();
+	l.tester->start_test(genes);
+	r.build_time = wall_time() - l.start;
+	w->build_time += r.build_time;
+	
+	//The profile lives in the record, which outlasts the creature
+	Creature* c = l.tester->creature;
+	if(profiling && c != NULL && c->circuit != NULL)
+	{
+		c->circuit->measure(r.circuit);
+		c->circuit->profile = &r.circuit;
+	}
+}
+
+//Same stepping as the interactive main loop.  When timed, each lane pays
+//for its own update and an equal share of the step.  The scene counts are
+//only sampled now and then, and with several lanes they are for the whole
+//scene.
+void ParallelEvaluator::tick(Worker* w, vector<int>& finished)
+{
+	const int SAMPLE_TICKS = 64;
+	
+	vector<Lane>& lanes = w->lanes;
+	NxScene* scene = w->scene;
+	bool timed = telemetry != NULL;
+	
+	int active = 0;
+	double t0 = timed ? wall_time() : 0.;
+	for(int i=0; i<(int)lanes.size(); i++)
+	{
+		Lane& l = lanes[i];
+		if(l.job < 0)
+			continue;
+		
+		bool running = l.tester->update();
+		if(timed)
+		{
+			double t1 = wall_time();
+			l.record.circuit_time += t1 - t0;
+			t0 = t1;
+		}
+		
+		if(running)
+			active++;
+		else
+			finished.push_back(i);
+	}
+	if(active == 0)
+		return;
+	
+	scene->simulate(time_step);
+	scene->flushStream();
+	scene->fetchResults(NX_RIGID_BODY_FINISHED, true);
+	if(!timed)
+		return;
+	
+	double share = (wall_time() - t0) / active;
+	NxSceneStats stats;
+	bool sampled = false;
+	for(int i=0; i<(int)lanes.size(); i++)
+	{
+		TrialRecord& r = lanes[i].record;
+		if(lanes[i].job < 0 || lanes[i].tester->creature == NULL)
+			continue;
+		
+		r.physics_time += share;
+		if(r.ticks % SAMPLE_TICKS == 0)
+		{
+			if(!sampled)
+				scene->getStats(stats);
+			sampled = true;
+			r.actors	= max(r.actors, (int)stats.numActors);
+			r.joints	= max(r.joints, (int)stats.numJoints);
+			r.contacts	= max(r.contacts, (int)stats.numContacts);
+		}
+		r.ticks++;
+	}
+}
+
+};
@@ -0,0 +1,139 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include <vector>
+#include <utility>
+#include <pthread.h>
+
+#include "common/sys_includes.h"
+#include "common/physics.h"
+
+#include "project/genotype.h"
+#include "project/population.h"
+#include "project/fitness.h"
+#include "project/telemetry.h"
+
+namespace Game
+{
+
+//Scores a whole generation in parallel.  Each worker thread owns its own scene
+//and pulls genotypes off a shared queue.  The interactive mode still goes
+//through Population::update() in the global scene.
+//
+//	A worker runs num_lanes trials side by side in its scene, each lane with
+//	its own fitness test, spot on the ground and collision group.  One step
+//	of the scene advances every lane, and a lane whose trial ends takes the
+//	next genotype straight away.
+struct ParallelEvaluator
+{
+	//Throws if trials names an unknown fitness test or num_lanes is out of
+	//range, at most MAX_LANES
+	ParallelEvaluator(
+		int num_threads,
+		float round_time,
+		float rest_time,
+		float time_step,
+		const TrialOptions& trials = TrialOptions(),
+		int num_lanes = 1);
+	~ParallelEvaluator();
+	
+	//Tests every genotype in species and writes the fitness back into it.
+	//Blocks until the whole generation has been scored.
+	void evaluate(vector< pair<float,Genotype> >& species);
+	
+	//Same, but only tests the species listed in jobs.  If stopped is given,
+	//the entries of the jobs are set to whether a stop rule cut them short.
+	void evaluate(
+		vector< pair<float,Genotype> >&	species,
+		const vector<int>&				jobs,
+		vector<char>*					stopped = NULL);
+	
+	int num_workers() const { return workers.size(); }
+	int num_lanes() const { return workers[0]->lanes.size(); }
+	
+	//Score the stop rules measure trials against, only valid between
+	//generations
+	void set_threshold(double threshold);
+	
+	//Number of trials the stop rules have cut short so far
+	int early_stops() const;
+	
+	//Each trial is timed and logged to telemetry, worker i produces as
+	//number i.  NULL turns it off again.  Only valid between generations.
+	void set_telemetry(Telemetry* t);
+	
+	//Generation number which goes into the trial records
+	void set_generation(int g) { generation = g; }
+	
+	//Actors created and reused by the workers' scenes so far.  Only valid
+	//between generations.
+	Common::PoolStats pool_stats() const;
+	
+	//Time spent building creatures in trials logged to telemetry
+	double build_time() const;
+	
+	//Counts and times every gate of the compiled circuits on trial, and
+	//adds the profile of each circuit to its trial record.  Only takes
+	//effect with telemetry on, and only valid between generations.
+	void set_profiling(bool on) { profiling = on; }
+	
+	//Sum of the circuit profiles since the last call, only valid between
+	//generations
+	CircuitProfile take_circuit_profile();
+
+	//Distance between neighbouring lanes
+	static const float LANE_SPACING;
+
+private:
+
+	//One trial slot in a worker's scene
+	struct Lane
+	{
+		FitnessTest*		tester;
+		int					job;	//Species on trial, -1 while idle
+		double				start;
+		TrialRecord			record;
+	};
+
+	struct Worker
+	{
+		ParallelEvaluator*	owner;
+		pthread_t			thread;
+		NxScene*			scene;
+		vector<Lane>		lanes;
+		int					index;
+		int					running;
+		double				build_time;
+		CircuitProfile		circuits;	//Of the trials finished so far
+	};
+	
+	static void* worker_main(void* data);
+	void run_worker(Worker* worker);
+	
+	//Builds the creature of a new trial
+	void start_lane(Worker* worker, Lane& lane, Genotype& genes);
+	
+	//Updates every running lane and steps the scene once, adds the lanes
+	//whose trial ended to finished
+	void tick(Worker* worker, vector<int>& finished);
+	
+	float						time_step;
+	Telemetry*					telemetry;
+	bool						profiling;
+	int							generation;
+	vector<Worker*>				workers;
+	
+	//Work queue, guarded by lock
+	pthread_mutex_t				lock;
+	pthread_cond_t				work_ready, work_done;
+	vector< pair<float,Genotype> >*	batch;
+	const vector<int>*			batch_jobs;
+	vector<char>*				batch_stopped;
+	int							next_job, jobs_done;
+	bool						quit;
+};
+
+};
+
+#endif
+
@@ -0,0 +1,272 @@
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "common/sys_includes.h"
+#include "common/physics.h"
+
+#include "project/fitness.h"
+#include "project/creature.h"
+#include "project/genotype.h"
+
+using namespace std;
+using namespace Common;
+
+namespace Game
+{
+
+FitnessTest::~FitnessTest()
+{
+	for(int i=0; i<(int)rules.size(); i++)
+		delete rules[i];
+}
+
+//Create a creature in the middle of space
+void FitnessTest::start_test(Genotype& genes)
+{
+	//genes.save(cout);
+
+	if(verbose)
+		cout << "Generating creature..." << endl;
+	NxMat34 start_pos;
+	start_pos.id();
+	start_pos.t = origin;
+
+	if(scene == NULL)
+		scene = Common::scene;
+	creature = genes.createCreature(scene, start_pos, collision_group, verbose);
+
+	if(creature == NULL && verbose)
+	{
+		cout << "Failed to construct creature!" << endl;
+	}
+
+	base_position = origin;
+	fitness = 1e-4;
+	stopped = false;
+	current_time = 0.;
+	max_height = -1e10;
+	max_rate = 0.;
+
+	for(int i=0; i<(int)rules.size(); i++)
+		rules[i]->reset();
+}
+
+//Update the creature's position
+bool FitnessTest::update()
+{
+	if(creature == NULL)
+		return false;
+
+	creature->update();
+	NxMat34 pose = creature->get_pose();
+	NxVec3 pos = pose.t;
+
+	if(current_time <= rest_time)
+	{
+		base_position = pos;
+	}
+
+	max_height = max(max_height, (double)pos.y);
+
+	//Update fitness function
+	double last = fitness;
+	fitness = measure(pos);
+	if(current_time > rest_time)
+		max_rate = max(max_rate, fitness - last);
+
+	for(int i=0; i<(int)creature->body.size(); i++)
+	{
+		BodyPart *p = creature->body[i];
+		for(int j=0; j<(int)p->joints.size(); j++)
+		{
+			if(p->joints[j]->getState() == NX_JS_BROKEN)
+			{
+				fitness = 0.0001;
+				end_trial();
+				return false;
+			}
+		}
+	}
+
+
+	current_time += 1.;
+
+	if(current_time > round_time || creature->body.size() <= 1)
+	{
+		end_trial();
+		return false;
+	}
+
+	if(current_time > rest_time)
+	{
+		for(int i=0; i<(int)rules.size(); i++)
+		{
+			if(rules[i]->stop(*this))
+			{
+				if(verbose)
+					cout << "Stopped by " << rules[i]->name() << " rule" << endl;
+				early_stops++;
+				stopped = true;
+				end_trial();
+				return false;
+			}
+		}
+	}
+
+	return true;
+
+}
+
+void FitnessTest::draw()
+{
+	if(creature != NULL)
+		creature->draw();
+}
+
+double FitnessTest::measure(const NxVec3& pos)
+{
+	return (pos - base_position).magnitude() + 1e-3;
+}
+
+void FitnessTest::end_trial()
+{
+	delete creature;
+	creature = NULL;
+}
+
+
+//Stop rules
+void StagnationRule::reset()
+{
+	best = 0.;
+	since = -1.;
+}
+
+bool StagnationRule::stop(const FitnessTest& test)
+{
+	if(since < 0. || test.fitness >= best + min_gain)
+	{
+		best = max(best, test.fitness);
+		since = test.current_time;
+		return false;
+	}
+	return test.current_time - since >= ticks;
+}
+
+bool HopelessRule::stop(const FitnessTest& test)
+{
+	if(test.current_time < test.rest_time + grace)
+		return false;
+	double bound = test.fitness + test.remaining() * test.max_rate * slack;
+	return bound < test.threshold;
+}
+
+
+//Height test
+double HeightTest::measure(const NxVec3& pos)
+{
+	if(current_time <= rest_time)
+		peak = pos.y;
+	else
+		peak = max(peak, (double)pos.y);
+	return peak - base_position.y + 1e-3;
+}
+
+
+//Swim test
+void SwimTest::start_test(Genotype& genes)
+{
+	if(scene == NULL)
+		scene = Common::scene;
+	scene->setGravity(NxVec3(0.f, 0.f, 0.f));
+	FitnessTest::start_test(genes);
+}
+
+//Rough area a part shows the water, a quarter of its surface
+static float cross_section(const BodyPart* p)
+{
+	switch(p->shape)
+	{
+		case BODY_BOX:
+			//size holds half extents
+			return 2.f * (p->size.x * p->size.y + p->size.y * p->size.z + p->size.z * p->size.x);
+		case BODY_SPHERE:
+			return (float)M_PI * p->radius * p->radius;
+		case BODY_CAPSULE:
+			return 2.f * p->radius * p->length + (float)M_PI * p->radius * p->radius;
+	}
+	return 0.f;
+}
+
+//Drag is added before the creature's own update, so it acts on the next step
+bool SwimTest::update()
+{
+	if(creature != NULL)
+	{
+		for(int i=0; i<(int)creature->body.size(); i++)
+		{
+			BodyPart* p = creature->body[i];
+			if(p->actor == NULL)
+				continue;
+			NxVec3 v = p->actor->getLinearVelocity();
+			p->actor->addForce(v * (-drag * cross_section(p) * v.magnitude()));
+		}
+	}
+	return FitnessTest::update();
+}
+
+
+//Target test
+NxVec3 TargetTest::target() const
+{
+	double a = 0.;
+	if(current_time > rest_time)
+		a = 2. * M_PI * (current_time - rest_time) / period;
+	return base_position + NxVec3(radius * cos(a), 0.f, radius * sin(a));
+}
+
+double TargetTest::measure(const NxVec3& pos)
+{
+	NxVec3 d = target() - pos;
+	d.y = 0.f;
+	double dist = d.magnitude();
+
+	if(current_time <= rest_time)
+		closed = 0.;
+	else
+		closed += last_distance - dist;
+	last_distance = dist;
+
+	return max(closed, 0.) + 1e-3;
+}
+
+
+FitnessTest* createFitnessTest(
+	const TrialOptions& opts,
+	float round_time,
+	float rest_time,
+	NxScene* scene)
+{
+	FitnessTest* test = NULL;
+	if(opts.test == "distance")
+		test = new FitnessTest(round_time, rest_time, scene);
+	else if(opts.test == "height")
+		test = new HeightTest(round_time, rest_time, scene);
+	else if(opts.test == "swim")
+		test = new SwimTest(round_time, rest_time, scene);
+	else if(opts.test == "target")
+		test = new TargetTest(round_time, rest_time, scene);
+	else
+		return NULL;
+
+	if(opts.stagnation > 0)
+		test->add_rule(new StagnationRule(opts.stagnation, opts.min_gain));
+	if(opts.hopeless)
+		test->add_rule(new HopelessRule(opts.slack));
+	return test;
+}
+
+};
@@ -0,0 +1,234 @@
+#ifndef FITNESS_H
+#define FITNESS_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "common/sys_includes.h"
+
+#include "project/creature.h"
+#include "project/genotype.h"
+
+namespace Game
+{
+
+struct StopRule;
+
+//Interface for a fitness test
+//
+//	The base test scores the distance the creature moved from where it was
+//	when the rest time ran out.  Other tests override measure() and keep the
+//	rest of the trial loop.  All times are in ticks, one per update().
+struct FitnessTest
+{
+	Creature* creature;
+	NxScene* scene;
+	NxVec3 base_position;
+
+	double current_time, round_time, rest_time, fitness;
+
+	double max_height;
+
+	//Largest gain in fitness over a single tick since the rest time ran out
+	double max_rate;
+
+	//Score a trial has to beat to matter, read by the stop rules.  Set
+	//before each generation, see Population::run_generation().
+	double threshold;
+
+	//Rules for ending a trial early, owned by the test
+	std::vector<StopRule*> rules;
+
+	//Number of trials ended by one of the rules
+	int early_stops;
+	
+	//Set if one of the rules ended the last trial, its score is then
+	//only an estimate
+	bool stopped;
+
+	//If false, don't chat on cout (used by the worker threads)
+	bool verbose;
+
+	//Where the creature is dropped and the collision group of its shapes,
+	//tests sharing a scene each get their own
+	NxVec3 origin;
+	NxCollisionGroup collision_group;
+
+	FitnessTest() {}
+	FitnessTest(
+		float round_time_,
+		float rest_time_,
+		NxScene* scene_ = NULL) :
+			creature(NULL),
+			scene(scene_),
+			round_time(round_time_),
+			rest_time(rest_time_),
+			threshold(0.),
+			early_stops(0),
+			stopped(false),
+			verbose(true),
+			origin(0., 0., 0.),
+			collision_group(0) {}
+	virtual ~FitnessTest();
+
+	virtual void start_test(Genotype& genes);
+	virtual bool update();
+	virtual void draw();
+
+	virtual const char* name() const { return "distance"; }
+
+	//Adds a stop rule, the test takes ownership
+	void add_rule(StopRule* rule) { rules.push_back(rule); }
+
+	//Ticks left until the end of the round
+	double remaining() const { return round_time - current_time; }
+
+protected:
+	//Fitness for the current tick, called after base_position and max_height
+	//have been updated
+	virtual double measure(const NxVec3& pos);
+
+	//Throws the creature away, the trial is over
+	void end_trial();
+};
+
+//Ends a trial before round_time once its outcome is clear.
+//
+//	reset() is called when a trial starts, stop() once per tick after the
+//	rest time.  Whatever fitness the test has at that point is its score.
+struct StopRule
+{
+	virtual ~StopRule() {}
+
+	virtual void reset() {}
+	virtual bool stop(const FitnessTest& test) = 0;
+
+	virtual const char* name() const = 0;
+};
+
+//Stops once fitness hasn't improved by min_gain for ticks ticks in a row
+struct StagnationRule : public StopRule
+{
+	StagnationRule(int ticks_, float min_gain_) :
+		ticks(ticks_), min_gain(min_gain_) {}
+
+	virtual void reset();
+	virtual bool stop(const FitnessTest& test);
+	virtual const char* name() const { return "stagnation"; }
+
+	int		ticks;
+	float	min_gain;
+
+private:
+	double	best, since;
+};
+
+//Stops once the trial can't reach the test's threshold any more.
+//
+//	The best it could still do is guessed from the fastest the fitness has
+//	gone up so far, times slack, over the ticks that are left.  This is a
+//	heuristic, a creature which only gets going late can be cut off.  No
+//	decision is made for the first grace ticks after the rest time.
+struct HopelessRule : public StopRule
+{
+	HopelessRule(float slack_ = 2., float grace_ = 1000.) :
+		slack(slack_), grace(grace_) {}
+
+	virtual bool stop(const FitnessTest& test);
+	virtual const char* name() const { return "hopeless"; }
+
+	float	slack;
+	float	grace;
+};
+
+//Highest point of the creature's root above its rest position
+struct HeightTest : public FitnessTest
+{
+	HeightTest(float round_time_, float rest_time_, NxScene* scene_ = NULL) :
+		FitnessTest(round_time_, rest_time_, scene_) {}
+
+	virtual const char* name() const { return "height"; }
+
+protected:
+	virtual double measure(const NxVec3& pos);
+
+private:
+	double	peak;
+};
+
+//Distance covered in water.  There is no fluid in the scene, so the test
+//turns gravity off and pulls every body part back with quadratic drag,
+//which makes a stroke that is faster than its recovery move the creature.
+//Leaves the scene weightless, give it a scene of its own.
+struct SwimTest : public FitnessTest
+{
+	SwimTest(float round_time_, float rest_time_, NxScene* scene_ = NULL, float drag_ = 1.) :
+		FitnessTest(round_time_, rest_time_, scene_), drag(drag_) {}
+
+	virtual void start_test(Genotype& genes);
+	virtual bool update();
+	virtual const char* name() const { return "swim"; }
+
+	float	drag;
+};
+
+//Chases a target which circles the rest position.  Scores the total
+//distance the creature closed on the target, so sitting still or drifting
+//off gets nothing.
+struct TargetTest : public FitnessTest
+{
+	TargetTest(
+		float round_time_,
+		float rest_time_,
+		NxScene* scene_ = NULL,
+		float radius_ = 10.,
+		float period_ = 5000.) :
+			FitnessTest(round_time_, rest_time_, scene_),
+			radius(radius_),
+			period(period_) {}
+
+	virtual const char* name() const { return "target"; }
+
+	//Where the target is at the current tick
+	NxVec3 target() const;
+
+	float	radius;		//Distance of the target from the rest position
+	float	period;		//Ticks per lap
+
+protected:
+	virtual double measure(const NxVec3& pos);
+
+private:
+	double	closed, last_distance;
+};
+
+//How the trials of a run are scored and cut short
+struct TrialOptions
+{
+	std::string	test;			//Name of the fitness test
+	int			stagnation;		//Stop after this many ticks without progress, 0 to disable
+	float		min_gain;		//Smallest gain in fitness which counts as progress
+	bool		hopeless;		//Stop trials which can't reach the top scores
+	float		slack;			//Safety factor of the hopeless rule
+
+	TrialOptions() :
+		test("distance"),
+		stagnation(0),
+		min_gain(1e-2),
+		hopeless(false),
+		slack(2.) {}
+};
+
+//Creates a fitness test with its stop rules, returns NULL if there is no
+//test of that name.  Tests are distance, height, swim and target.
+FitnessTest* createFitnessTest(
+	const TrialOptions& opts,
+	float round_time,
+	float rest_time,
+	NxScene* scene = NULL);
+
+};
+
+#endif
+
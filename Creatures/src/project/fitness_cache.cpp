@@ -0,0 +1,106 @@
+#include <string>
+#include <sstream>
+#include <list>
+#include <map>
+
+#include "project/genotype_io.h"
+#include "project/fitness_cache.h"
+
+using namespace std;
+
+namespace Game
+{
+
+GenotypeKey::GenotypeKey(const Genotype& genes)
+{
+	ostringstream os;
+	save_binary(genes, os);
+	blob = os.str();
+
+	hash = 14695981039346656037ULL;
+	for(int i=0; i<(int)blob.size(); i++)
+	{
+		hash ^= (unsigned char)blob[i];
+		hash *= 1099511628211ULL;
+	}
+}
+
+FitnessCache::FitnessCache(int capacity_) :
+	capacity(capacity_),
+	hits(0),
+	misses(0)
+{
+}
+
+FitnessCache::Index::iterator FitnessCache::lookup(const GenotypeKey& key)
+{
+	pair<Index::iterator, Index::iterator> range = index.equal_range(key.hash);
+	for(Index::iterator it=range.first; it!=range.second; ++it)
+	{
+		if(it->second->key == key)
+			return it;
+	}
+	return index.end();
+}
+
+bool FitnessCache::find(const GenotypeKey& key, float& fitness)
+{
+	Index::iterator it = lookup(key);
+	if(it == index.end())
+	{
+		misses++;
+		return false;
+	}
+
+	//Move to the front, list iterators stay valid
+	entries.splice(entries.begin(), entries, it->second);
+	fitness = it->second->fitness;
+	hits++;
+	return true;
+}
+
+void FitnessCache::insert(const GenotypeKey& key, float fitness)
+{
+	if(capacity <= 0)
+		return;
+
+	Index::iterator it = lookup(key);
+	if(it != index.end())
+	{
+		entries.splice(entries.begin(), entries, it->second);
+		it->second->fitness = fitness;
+		return;
+	}
+
+	//Evict from the back
+	while((int)entries.size() >= capacity)
+	{
+		EntryList::iterator last = --entries.end();
+		pair<Index::iterator, Index::iterator> range = index.equal_range(last->key.hash);
+		for(Index::iterator j=range.first; j!=range.second; ++j)
+		{
+			if(j->second == last)
+			{
+				index.erase(j);
+				break;
+			}
+		}
+		entries.pop_back();
+	}
+
+	Entry e;
+	e.key		= key;
+	e.fitness	= fitness;
+	entries.push_front(e);
+	index.insert(make_pair(key.hash, entries.begin()));
+}
+
+void FitnessCache::clear()
+{
+	entries.clear();
+	index.clear();
+	hits = 0;
+	misses = 0;
+}
+
+};
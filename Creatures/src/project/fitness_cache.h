@@ -0,0 +1,74 @@
+#ifndef FITNESS_CACHE_H
+#define FITNESS_CACHE_H
+
+#include <string>
+#include <list>
+#include <map>
+
+#include "common/sys_includes.h"
+#include "project/genotype.h"
+
+namespace Game
+{
+
+//Canonical form of a genotype, its binary encoding (see genotype_io.h) plus
+//a hash of it.  Two normalized genotypes have the same key exactly when they
+//have the same genes.
+struct GenotypeKey
+{
+	GenotypeKey() : hash(0) {}
+	explicit GenotypeKey(const Genotype& genes);
+
+	bool operator==(const GenotypeKey& other) const
+	{
+		return hash == other.hash && blob == other.blob;
+	}
+
+	NxU64		hash;		//64 bit FNV-1a of blob
+	std::string	blob;
+};
+
+//Remembers the fitness of recently scored genotypes.
+//
+//	Parents picked twice, and children which came out of mutation unchanged,
+//	can then take a known score instead of another trial.  Only worth it if
+//	a trial gives the same score every time.  Lookups go through the hash,
+//	the blob rules out collisions.  Once full, the least recently used
+//	entry is dropped.
+struct FitnessCache
+{
+	explicit FitnessCache(int capacity = 4096);
+
+	//Returns true and sets fitness on a hit, which also refreshes the entry
+	bool find(const GenotypeKey& key, float& fitness);
+
+	//Adds or updates an entry
+	void insert(const GenotypeKey& key, float fitness);
+
+	void clear();
+	int size() const { return entries.size(); }
+
+	int		capacity;
+
+	//Lookup statistics since the last clear()
+	int		hits, misses;
+
+private:
+	struct Entry
+	{
+		GenotypeKey	key;
+		float		fitness;
+	};
+
+	typedef std::list<Entry>					EntryList;
+	typedef std::multimap<NxU64, EntryList::iterator>	Index;
+
+	EntryList	entries;	//Most recently used first
+	Index		index;
+
+	Index::iterator lookup(const GenotypeKey& key);
+};
+
+};
+
+#endif
@@ -9,6 +9,7 @@
 #include "project/genotype.h"
 #include "project/mutation.h"
 #include "project/population.h"
+#include "project/scheduler.h"
 
 //STL stuff
 #include <iostream>
@@ -31,48 +32,28 @@ float fov			= 45.0f;
 float z_near		= 0.5f;
 float z_far			= 1200.0f;
 float delta_t		= 0.01;
-
-bool paused			= false;
-
-//Number of extra frames to run
-int frame_skip		= 0;
+float tick_rate		= 100.;
+float frame_time	= 1. / 60.;
 
 NxMat34 camera;
 
 
 
-//Scenario stuff
-int floor_height = -75.; 
-
-
 //Creature* critter;
 //Genotype test;
 
 Population*	population;
 
+//Runs the population's trials, the main thread only draws
+Scheduler*	scheduler;
+
 
 //The scenario
 void init_scenario()
 {
 	camera.id();
 	
-	
-	srand(time(NULL));
-
-	// Set default material (values taken from boxes demo, need to mess with this)
-	NxMaterial* defaultMaterial = scene->getMaterialFromIndex(0);
-	defaultMaterial->setRestitution(0.f);
-	defaultMaterial->setStaticFriction(.5f);
-	defaultMaterial->setDynamicFriction(.5f);
-
-	// Create ground plane
-	NxPlaneShapeDesc planeDesc;
-	planeDesc.normal = NxVec3(0, 1, 0);
-	planeDesc.d = floor_height;
-
-	NxActorDesc actorDesc;
-	actorDesc.shapes.pushBack(&planeDesc);
-	scene->createActor(actorDesc);
+	//Ground plane and materials are set up by create_scene()
 }
 
 
@@ -126,7 +107,16 @@ void init()
 	population = new Population(
 		150,
 		10,
-		tester);
+		tester,
+		Random(time(NULL)));
+	
+	scheduler = new Scheduler(population, scene, delta_t, tick_rate);
+}
+
+void shutdown()
+{
+	delete scheduler;
+	scheduler = NULL;
 }
 
 
@@ -165,9 +155,6 @@ void update()
 	}
 */
 
-	population->update();
-
-
 	NxMat34 trans;
 	trans.id();
 
@@ -197,21 +184,36 @@ void update()
 	}
 	
 	
+	//Halve, double or uncap the simulation rate, the display keeps its own
 	if(key_press('-'))
 	{
-		frame_skip -= 25;
-		cout << "frameskip = " << frame_skip << endl;
+		tick_rate = max(tick_rate / 2.f, 1.f);
+		scheduler->set_rate(tick_rate);
+		cout << "tick rate = " << tick_rate << endl;
 	}
 	if(key_press('='))
 	{
-		frame_skip += 25;
-		cout << "frameskip = " << frame_skip << endl;
+		tick_rate *= 2.f;
+		scheduler->set_rate(tick_rate);
+		cout << "tick rate = " << tick_rate << endl;
+	}
+	if(key_press('0'))
+	{
+		scheduler->set_rate(scheduler->get_rate() > 0. ? 0. : tick_rate);
+		if(scheduler->get_rate() > 0.)
+			cout << "tick rate = " << tick_rate << endl;
+		else
+			cout << "tick rate = unlimited" << endl;
+	}
+	if(key_press('p'))
+	{
+		scheduler->set_paused(!scheduler->is_paused());
 	}
-	frame_skip = max(frame_skip, 0);
 	
 	if(key_down('x'))
 	{
-		camera = population->tester->creature->get_pose();
+		camera.id();
+		camera.t = scheduler->snapshot().focus;
 	}
 
 	
@@ -231,11 +233,12 @@ void draw()
 	static float theta = 0.;
 	static float radius = 250.;
 	
-	if(population->tester->creature != NULL)
+	const Snapshot& snapshot = scheduler->snapshot();
+	
+	if(snapshot.has_creature)
 	{
 	
-	NxMat34 creature_pose = population->tester->creature->get_pose();
-	NxVec3 loc = creature_pose.t;
+	NxVec3 loc = snapshot.focus;
 	
 	gluLookAt(
 		loc.x + cos(theta) * radius, loc.y + radius/3, loc.z + sin(theta) * radius,
@@ -264,7 +267,8 @@ void draw()
 	
 	//Draw critter
 	//critter->draw();
-	population->draw();
+	for(int i=0; i<(int)snapshot.parts.size(); i++)
+		snapshot.parts[i].draw();
 }
 
 
@@ -16,7 +16,11 @@ namespace Game
 	//Time quantum
 	extern float delta_t;
 	
-	extern int frame_skip;
+	//Simulation ticks per second of wall time, 0 to run flat out
+	extern float tick_rate;
+	
+	//Time between frames on screen
+	extern float frame_time;
 	
 
 	//Initialization function
@@ -30,6 +34,9 @@ namespace Game
 	
 	//HUD stuff / overlays
 	void overlays();
+	
+	//Stops the simulation thread, call before exiting
+	void shutdown();
 };
 
 #endif
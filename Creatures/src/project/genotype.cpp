@@ -5,6 +5,8 @@
 #include <utility>
 #include <cmath>
 #include <locale>
+#include <cstring>
+#include <algorithm>
 
 #include "common/sys_includes.h"
 #include "common/physics.h"
@@ -78,7 +80,7 @@ GateEdge GateEdge::load(istream& is)
 //Gate nodes
 void GateNode::save(ostream& os) const
 {
-	os << "GATE " << name << ' ' << params.size();
+	os << "GATE " << gateName(id) << ' ' << params.size();
 	for(int i=0; i<(int)params.size(); i++)
 		os << ' ' << params[i];
 	os << endl << wires.size() << endl;
@@ -91,10 +93,12 @@ GateNode GateNode::load(istream& is)
 	assert_token(is, "GATE");
 	
 	GateNode res;
+	string name;
 	int num_params;
-	if(!(is >> res.name >> num_params))
+	if(!(is >> name >> num_params))
 	{	throw "Error reading gate description";
 	}
+	res.id = gateId(name);
 	
 	res.params.resize(num_params);
 	for(int i=0; i<num_params; i++)
@@ -182,10 +186,10 @@ Node Node::load(istream& is)
 	{
 		throw "Expected gate count";
 	}
-	res.gates.resize(num_gates);
+	res.gates.reserve(num_gates);
 	for(int i=0; i<num_gates; i++)
 	{
-		res.gates[i] = GateNode::load(is);
+		res.gates.push_back(GateNode::load(is));
 	}
 	
 	return res;
@@ -267,23 +271,24 @@ Genotype Genotype::load(istream& is)
 		
 	Genotype res;
 	res.root = root;
-	res.nodes.resize(n_nodes);
-	res.edges.resize(n_nodes);
+	res.nodes.reserve(n_nodes);
+	res.edges.reserve(n_nodes);
 	
 	for(int i=0; i<n_nodes; i++)
 	{
-		res.nodes[i] = Node::load(is);
+		res.nodes.push_back(Node::load(is));
 	
 		int n_edges;
 		is >> n_edges;
 		
-		res.edges[i].resize(n_edges);
+		vector<Edge> list(n_edges);
 		for(int j=0; j<n_edges; j++)
 		{
-			res.edges[i][j] = Edge::load(is);
-			assert(res.edges[i][j].source == i);
-			assert(res.edges[i][j].target < n_nodes && res.edges[i][j].target >= 0);
+			list[j] = Edge::load(is);
+			assert(list[j].source == i);
+			assert(list[j].target < n_nodes && list[j].target >= 0);
 		}
+		res.edges.push_back(list);
 	}
 	
 	//Do clean up
@@ -294,7 +299,7 @@ Genotype Genotype::load(istream& is)
 
 
 
-NxVec3 Node::closest_pt(const NxVec3& p)
+NxVec3 Node::closest_pt(const NxVec3& p) const
 {
 	NxVec3 res = p;
 
@@ -338,7 +343,7 @@ NxVec3 Node::closest_pt(const NxVec3& p)
 }
 
 void GateEdge::normalize(
-	Genotype& genes,
+	const Genotype& genes,
 	int n,
 	int g)
 {
@@ -398,23 +403,31 @@ void GateEdge::normalize(
 
 void GateNode::normalize()
 {
-	//Force name to lower case
-	for(int i=0; i<(int)name.size(); i++)
-		name[i] = tolower(name[i]);
-
 	//Get factory
-	GateFactory* f = getFactory(name);
+	GateFactory* f = getFactory(id);
 	
-	//No factory, make up some random name
+	//Unknown gate, fall back to an add gate.  Normalizing has no random
+	//state to draw from, and loading a file must give the same genes every time.
 	if(f == NULL)
 	{
-		name = randomGateName();
-		f = getFactory(name);
+		id = 0;
+		f = getFactory(id);
 	}
 
 	f->normalize(params);
 }
 
+bool GateNode::is_normal(vector<float>& scratch) const
+{
+	GateFactory* f = getFactory(id);
+	if(f == NULL)
+		return false;
+	
+	scratch.assign(params.begin(), params.end());
+	f->normalize(scratch);
+	return scratch == params;
+}
+
 void Node::normalize()
 {
 	//Clamp color range to [0,1]
@@ -432,6 +445,15 @@ void Node::normalize()
 	length = max(length, 1.f);
 }
 
+bool Node::same_body(const Node& other) const
+{
+	return	color == other.color &&
+			shape == other.shape &&
+			size == other.size &&
+			radius == other.radius &&
+			length == other.length;
+}
+
 NxVec3 max_dim(NxVec3 sz, NxVec3 v)
 {
 	NxVec3 res = NxVec3(0,0,0);
@@ -451,10 +473,8 @@ NxVec3 max_dim(NxVec3 sz, NxVec3 v)
 
 
 //Normalizes an edge
-void Edge::normalize(Genotype& genes)
+void Edge::normalize(const Genotype& genes)
 {
-	marked = false;
-
 	//Fix up the quaternion
 	rot.normalize();
 	
@@ -501,30 +521,145 @@ void Edge::normalize(Genotype& genes)
 }
 
 
+//Edges and wires are plain data without padding, so compare them bitwise
+template<class T> static bool same_bits(const T& a, const T& b)
+{
+	return memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+//The steps of normalize().  Each piece is normalized on the side and only
+//written back if it changed, so that parts shared with the parent genotype
+//stay shared.
+static void normalize_body(Genotype& genes, int i)
+{
+	Node n = genes.nodes[i];
+	n.normalize();
+	if(!n.same_body(genes.nodes[i]))
+		genes.nodes.edit(i) = n;
+}
+
+static void normalize_gate(Genotype& genes, int i, int j, vector<float>& scratch)
+{
+	if(!genes.nodes[i].gates[j].is_normal(scratch))
+		genes.nodes.edit(i).gates.edit(j).normalize();
+}
+
+static void normalize_wire(Genotype& genes, int i, int j, int k)
+{
+	GateEdge w = genes.nodes[i].gates[j].wires[k];
+	w.normalize(genes, i, j);
+	if(!same_bits(w, genes.nodes[i].gates[j].wires[k]))
+		genes.nodes.edit(i).gates.edit(j).wires[k] = w;
+}
+
+static void normalize_circuit(Genotype& genes, int i, vector<float>& scratch)
+{
+	for(int j=0; j<(int)genes.nodes[i].gates.size(); j++)
+	{
+		normalize_gate(genes, i, j, scratch);
+		for(int k=0; k<(int)genes.nodes[i].gates[j].wires.size(); k++)
+			normalize_wire(genes, i, j, k);
+	}
+}
+
+static void normalize_edge(Genotype& genes, int i, int j)
+{
+	Edge e = genes.edges[i][j];
+	e.source = i;
+	e.normalize(genes);
+	if(!same_bits(e, genes.edges[i][j]))
+		genes.edges.edit(i)[j] = e;
+}
+
 //Normalizes all parameters to be within acceptable bounds.  This is necessary
 //because stuff might get fucked up due to mutation or dumb user input.
 void Genotype::normalize()
 {
+	vector<float> scratch;
+	
 	for(int i=0; i<(int)nodes.size(); i++)
 	{
-		nodes[i].normalize();
-		for(int j=0; j<(int)nodes[i].gates.size(); j++)
+		normalize_body(*this, i);
+		normalize_circuit(*this, i, scratch);
+	}
+	
+	//Clean up edges
+	for(int i=0; i<(int)edges.size(); i++)
+	for(int j=0; j<(int)edges[i].size(); j++)
+		normalize_edge(*this, i, j);
+}
+
+//A wire depends on its own node and on the node it names.  Edges depend on
+//the bodies at both ends.  Bodies go first, like in the full pass.  The scans
+//for wires and edges pointing at a changed node only compare indices.
+void Genotype::normalize(const DirtySet& dirty)
+{
+	if(dirty.all)
+	{
+		normalize();
+		return;
+	}
+	
+	vector<float> scratch;
+	
+	if(dirty.any & DirtySet::BODY)
+	{
+		for(int i=0; i<(int)nodes.size(); i++)
 		{
-			nodes[i].gates[j].normalize();
+			if(dirty.get(i) & DirtySet::BODY)
+				normalize_body(*this, i);
+		}
+	}
+	
+	//A reshaped node gets its whole circuit redone, which covers anything
+	//listed in it
+	for(int x=0; x<(int)dirty.gates.size(); x++)
+	{
+		int i = dirty.gates[x].first, j = dirty.gates[x].second;
+		if(!(dirty.get(i) & DirtySet::SHAPE) && j < (int)nodes[i].gates.size())
+			normalize_gate(*this, i, j, scratch);
+	}
+	for(int x=0; x<(int)dirty.wires.size(); x++)
+	{
+		int i = dirty.wires[x].first,
+			j = dirty.wires[x].second.first,
+			k = dirty.wires[x].second.second;
+		if(!(dirty.get(i) & DirtySet::SHAPE) &&
+		   j < (int)nodes[i].gates.size() &&
+		   k < (int)nodes[i].gates[j].wires.size())
+			normalize_wire(*this, i, j, k);
+	}
+	
+	if(dirty.any & DirtySet::SHAPE)
+	{
+		for(int i=0; i<(int)nodes.size(); i++)
+		{
+			if(dirty.get(i) & DirtySet::SHAPE)
+			{
+				normalize_circuit(*this, i, scratch);
+				continue;
+			}
 			
+			for(int j=0; j<(int)nodes[i].gates.size(); j++)
 			for(int k=0; k<(int)nodes[i].gates[j].wires.size(); k++)
 			{
-				nodes[i].gates[j].wires[k].normalize(*this, i, j);
+				if(dirty.get(nodes[i].gates[j].wires[k].node) & DirtySet::SHAPE)
+					normalize_wire(*this, i, j, k);
 			}
 		}
 	}
 	
-	//Clean up edges
-	for(int i=0; i<(int)edges.size(); i++)
-	for(int j=0; j<(int)edges[i].size(); j++)
+	if(dirty.any & (DirtySet::EDGES | DirtySet::BODY))
 	{
-		edges[i][j].source = i;
-		edges[i][j].normalize(*this);
+		for(int i=0; i<(int)edges.size(); i++)
+		{
+			bool whole = (dirty.get(i) & (DirtySet::EDGES | DirtySet::BODY)) != 0;
+			for(int j=0; j<(int)edges[i].size(); j++)
+			{
+				if(whole || (dirty.get(edges[i][j].target) & DirtySet::BODY))
+					normalize_edge(*this, i, j);
+			}
+		}
 	}
 }
 
@@ -533,13 +668,14 @@ void Genotype::remove_node(int n)
 {
 	//Remove object
 	int T = nodes.size() - 1;
-	edges[n] = edges[T];
-	nodes[n] = nodes[T];
+	edges.copy(n, T);
+	nodes.copy(n, T);
 	edges.resize(T);
 	nodes.resize(T);
 	
+	//The last node moved into slot n, unless it was the one removed
 	if(root == T)
-		root = n;
+		root = n < T ? n : 0;
 	
 	//Update edges	
 	for(int i=0; i<(int)edges.size(); i++)
@@ -552,7 +688,7 @@ void Genotype::remove_node(int n)
 		}
 		else if(edges[i][j].target == T)
 		{
-			edges[i][j].target = n;
+			edges.edit(i)[j].target = n;
 		}
 	}
 }
@@ -561,16 +697,16 @@ void Genotype::remove_edge(int s, int x)
 {
 	int T = edges[s].size() - 1;
 	
-	edges[s][x] = edges[s][T];
-	edges[s].resize(T);
+	vector<Edge>& list = edges.edit(s);
+	list[x] = list[T];
+	list.resize(T);
 	
 	//Need to update gates somehow
 	for(int i=0; i<(int)nodes[s].gates.size(); i++)
 	{
-		GateNode& g = nodes[s].gates[i];
-		for(int j=0; j<(int)g.wires.size(); j++)
+		for(int j=0; j<(int)nodes[s].gates[i].wires.size(); j++)
 		{
-			GateEdge w = g.wires[j];
+			GateEdge w = nodes[s].gates[i].wires[j];
 			if(w.node_type != NODE_CHILD || edges[s].size() == 0)
 				continue;
 				
@@ -588,23 +724,23 @@ void Genotype::remove_edge(int s, int x)
 	}
 }
 
-void Genotype::remove_gate(int n, int g)
+//Control wires into the removed gate are dropped, which moves other wires of
+//their gate around, so those nodes get marked in dirty
+void Genotype::remove_gate(int n, int g, DirtySet* dirty)
 {
-	Node& N = nodes[n];
+	Node& N = nodes.edit(n);
 
 	int T = N.gates.size()-1;
-	N.gates[g] = N.gates[T];
+	N.gates.copy(g, T);
 	N.gates.resize(T);
 	
 	for(int s=0; s<(int)nodes.size(); s++)
 	{
-		Node& nn = nodes[s];
-		for(int i=0; i<(int)nn.gates.size(); i++)
+		for(int i=0; i<(int)nodes[s].gates.size(); i++)
 		{
-			GateNode& gg = nn.gates[i];
-			for(int j=0; j<(int)gg.wires.size(); j++)
+			for(int j=0; j<(int)nodes[s].gates[i].wires.size(); j++)
 			{
-				GateEdge& w = gg.wires[j];
+				const GateEdge& w = nodes[s].gates[i].wires[j];
 				if(	w.node_type == NODE_CURRENT ||
 					w.gate_type != GATE_CONTROL ||
 					edges[s].size() == 0 ||
@@ -615,10 +751,8 @@ void Genotype::remove_gate(int n, int g)
 				{
 					remove_wire(s, i, j);
 					j--;
-				}
-				else if(w.gate == T)
-				{
-					w.gate = T;
+					if(dirty)
+						dirty->mark(s, DirtySet::SHAPE);
 				}
 			}
 		}
@@ -627,32 +761,294 @@ void Genotype::remove_gate(int n, int g)
 
 void Genotype::remove_wire(int n, int g, int w)
 {
-	GateNode& gg = nodes[n].gates[g];
+	GateNode& gg = nodes.edit(n).gates.edit(g);
 	gg.wires[w] = gg.wires[gg.wires.size()-1];
 	gg.wires.resize(gg.wires.size()-1);
 }
 
+//Where a wire gene may end up in a built creature.  Which limbs get built
+//can't be told from the genes, so a child wire may land in any child or
+//fall back on its own part, and a sensor or effector wire may fall through
+//to a control gate of a part without limbs.  Mirrors rigWires().
+struct WireEnds
+{
+	bool						sensor, effector;
+	vector< pair<int,int> >		controls;	//As (node, gate)
+	
+	WireEnds() : sensor(false), effector(false) {}
+};
+
+static void wire_ends(const Genotype& genes, int n, const GateEdge& w, WireEnds& res)
+{
+	vector<int> parts(1, n);
+	if(w.node_type == NODE_CHILD)
+	{
+		for(int e=0; e<(int)genes.edges[n].size(); e++)
+			parts.push_back(genes.edges[n][e].target);
+	}
+	
+	for(int i=0; i<(int)parts.size(); i++)
+	{
+		int m = parts[i];
+		bool limbs = genes.edges[m].size() > 0;
+		res.sensor |= w.gate_type == GATE_SENSOR && limbs;
+		res.effector |= w.gate_type == GATE_EFFECTOR && limbs;
+		
+		//A part without control gates wires the gate to itself
+		int count = genes.nodes[m].gates.size();
+		if(count > 0)
+			res.controls.push_back(make_pair(m, (int)(w.gate % (unsigned)count)));
+	}
+}
+
+//Raises bound[n] so that gate g of node n keeps its index
+static void pin_gate(const Genotype& genes, vector<int>& bound, int n, int g)
+{
+	int count = genes.nodes[n].gates.size();
+	bound[n] = max(bound[n], g >= 0 && g < count ? g + 1 : count);
+}
+
+//A control gate is live if signal from it can flow into an effector, and
+//wires are only stripped between dead gates.  Taking a wire off a live gate,
+//a sensor or an effector would shift the positions of its other wires, which
+//the gates read by number.  Dead gates stay where they are, except for a run
+//of wireless ones at the end of a node which no wire can resolve to even
+//modulo the shorter count; the compiled circuit leaves the rest out anyway.
+int Genotype::prune()
+{
+	//Where every wire ends, in gate and wire order
+	vector< vector< vector<WireEnds> > > ends(nodes.size());
+	vector< vector<char> > live(nodes.size());
+	for(int n=0; n<(int)nodes.size(); n++)
+	{
+		const Node& node = nodes[n];
+		ends[n].resize(node.gates.size());
+		live[n].resize(node.gates.size(), 0);
+		for(int i=0; i<(int)node.gates.size(); i++)
+		{
+			ends[n][i].resize(node.gates[i].wires.size());
+			for(int j=0; j<(int)node.gates[i].wires.size(); j++)
+				wire_ends(*this, n, node.gates[i].wires[j], ends[n][i][j]);
+		}
+	}
+	
+	//Flood backwards from the effectors until nothing changes
+	bool changed = true;
+	while(changed)
+	{
+		changed = false;
+		for(int n=0; n<(int)nodes.size(); n++)
+		for(int i=0; i<(int)ends[n].size(); i++)
+		for(int j=0; j<(int)ends[n][i].size(); j++)
+		{
+			const WireEnds& e = ends[n][i][j];
+			if(nodes[n].gates[i].wires[j].direction > 0)
+			{
+				//Flows from the far end into this gate
+				if(!live[n][i])
+					continue;
+				for(int k=0; k<(int)e.controls.size(); k++)
+				{
+					char& l = live[e.controls[k].first][e.controls[k].second];
+					changed |= !l;
+					l = 1;
+				}
+			}
+			else if(!live[n][i])
+			{
+				bool reaches = e.effector;
+				for(int k=0; !reaches && k<(int)e.controls.size(); k++)
+					reaches = live[e.controls[k].first][e.controls[k].second];
+				if(reaches)
+				{
+					live[n][i] = 1;
+					changed = true;
+				}
+			}
+		}
+	}
+	
+	//Strip wires which join dead gates only, keeping their order
+	int removed = 0;
+	for(int n=0; n<(int)nodes.size(); n++)
+	for(int i=0; i<(int)ends[n].size(); i++)
+	{
+		if(live[n][i])
+			continue;
+		
+		vector<GateEdge> kept;
+		vector<WireEnds> kept_ends;
+		const vector<GateEdge>& wires = nodes[n].gates[i].wires;
+		for(int j=0; j<(int)wires.size(); j++)
+		{
+			const WireEnds& e = ends[n][i][j];
+			bool dead = !e.sensor && !e.effector;
+			for(int k=0; dead && k<(int)e.controls.size(); k++)
+				dead = !live[e.controls[k].first][e.controls[k].second];
+			if(dead)
+				continue;
+			kept.push_back(wires[j]);
+			kept_ends.push_back(e);
+		}
+		
+		if(kept.size() < wires.size())
+		{
+			removed += wires.size() - kept.size();
+			nodes.edit(n).gates.edit(i).wires.swap(kept);
+			ends[n][i].swap(kept_ends);
+		}
+	}
+	
+	//Each node keeps enough gates that every wire which may resolve to one
+	//of them, or which normalize() checks against them, keeps its index.
+	//A gate number out of range wraps around, so it pins the whole node.
+	vector<int> bound(nodes.size(), 0);
+	for(int n=0; n<(int)nodes.size(); n++)
+	for(int i=0; i<(int)ends[n].size(); i++)
+	for(int j=0; j<(int)ends[n][i].size(); j++)
+	{
+		const GateEdge& w = nodes[n].gates[i].wires[j];
+		const WireEnds& e = ends[n][i][j];
+		for(int k=0; k<(int)e.controls.size(); k++)
+			pin_gate(*this, bound, e.controls[k].first, w.gate);
+		if(w.gate_type == GATE_CONTROL)
+			pin_gate(*this, bound, w.node_type == NODE_CURRENT ? n : w.node % (unsigned)nodes.size(), w.gate);
+	}
+	
+	for(int n=0; n<(int)nodes.size(); n++)
+	{
+		int count = nodes[n].gates.size();
+		while(count > bound[n] && !live[n][count-1] && ends[n][count-1].empty())
+			count--;
+		if(count < (int)nodes[n].gates.size())
+		{
+			removed += nodes[n].gates.size() - count;
+			nodes.edit(n).gates.resize(count);
+		}
+	}
+	
+	return removed;
+}
+
+int Genotype::circuit_size() const
+{
+	int n = 0;
+	for(int i=0; i<(int)nodes.size(); i++)
+	{
+		const Node& node = nodes[i];
+		n += node.gates.size();
+		for(int j=0; j<(int)node.gates.size(); j++)
+			n += node.gates[j].wires.size();
+	}
+	return n;
+}
+
+//Instantiates the control gates of a node in a body part
+void createGates(const Node& node, BodyPart* res)
+{
+	for(int i=0; i<(int)node.gates.size(); i++)
+	{
+		GateFactory* gf = getFactory(node.gates[i].id);
+		res->controls.push_back(gf->createGate(node.gates[i].params, res->owner->arena));
+	}
+}
+
+//Connects the gates of a body part, must be called after all limbs are attached
+void rigWires(const Node& node, BodyPart* res)
+{
+	for(int i=0; i<(int)node.gates.size(); i++)
+	{
+		for(int j=0; j<(int)node.gates[i].wires.size(); j++)
+		{
+			GateEdge ge = node.gates[i].wires[j];
+			
+			//Hard part: need to find target gate
+			BodyPart* container;
+			switch(ge.node_type)
+			{
+				case NODE_CURRENT:
+					container = res;
+				break;
+				case NODE_CHILD:
+				
+					if(res->limbs.size() > 0)
+						container = res->limbs[ge.node % res->limbs.size()];
+					else
+						container = res;
+				break;
+				
+				default: assert(false);
+			}
+			
+			Gate * a = res->controls[i];
+			Gate* b = a;
+			switch(ge.gate_type)
+			{
+				case GATE_SENSOR:
+				if(container->sensors.size() > 0)
+				{	b = container->sensors[ge.gate % container->sensors.size()];
+					break;
+				}
+				case GATE_EFFECTOR:
+				if(container->effectors.size() > 0)
+				{	b = container->effectors[ge.gate % container->effectors.size()];
+					break;
+				}
+
+				case GATE_CONTROL:
+				if(container->controls.size() > 0)
+					b = container->controls[ge.gate % container->controls.size()];
+				break;
+				
+				default: assert(false);
+			}
+			
+			//Get default gate
+			if(ge.direction > 0)
+				swap(a, b);
+
+			//Add wire
+			Wire * wire = new (res->owner->arena) Wire();
+			res->wires.push_back(wire);
+			
+			//Connect gates
+			a->outputs.push_back(wire);
+			b->inputs.push_back(wire);
+		}
+	}
+}
+
+EdgeMarks::EdgeMarks(const Genotype& genes) :
+	first(genes.edges.size() + 1, 0)
+{
+	for(int i=0; i<(int)genes.edges.size(); i++)
+		first[i+1] = first[i] + genes.edges[i].size();
+	marks.resize(first.back(), 0);
+}
+
 //Generates a body part
 BodyPart* genCreatureRec(
-	Genotype&			genes,
+	const Genotype&		genes,
+	EdgeMarks&			marks,
 	Creature*			creature,
 	int					n,
 	NxMat34				pose,
 	float				scale,
-	float				reflect)
+	float				reflect,
+	bool				verbose)
 {
-	Node& node = genes.nodes[n];
+	const Node& node = genes.nodes[n];
 
 	//Generate the part at this node
 	BodyPart* res;
 	switch(node.shape)
 	{
 		case BODY_BOX:
-			res = new BodyPart(creature, node.color, pose, node.size * scale);
+			res = new (creature->arena) BodyPart(creature, node.color, pose, node.size * scale);
 		break;
 	
 		case BODY_SPHERE:
-			res = new BodyPart(creature, node.color, pose, node.radius * scale);
+			res = new (creature->arena) BodyPart(creature, node.color, pose, node.radius * scale);
 		break;
 	
 		case BODY_CAPSULE:
@@ -666,7 +1062,7 @@ BodyPart* genCreatureRec(
 	//If fails, then return NULL
 	if(res->actor == NULL)
 	{
-		delete res;
+		creature->release_part(res);
 		return NULL;
 	}
 
@@ -674,21 +1070,17 @@ BodyPart* genCreatureRec(
 	creature->body.push_back(res);
 	
 	//Generate gates
-	for(int i=0; i<(int)node.gates.size(); i++)
-	{
-		GateFactory* gf = getFactory(node.gates[i].name);	
-		res->controls.push_back(gf->createGate(node.gates[i].params));
-	}
+	createGates(node, res);
 	
 	//For each edge:
 	for(int i=0; i<(int)genes.edges[n].size(); i++)
 	{
-		Edge& edge = genes.edges[n][i];
+		const Edge& edge = genes.edges[n][i];
 		
 		//Check for mark
-		if(edge.marked)
+		if(marks.marked(n, i))
 			continue;
-		edge.marked = true;
+		marks.mark(n, i, true);
 		
 	
 		NxMat33 R = edge.rot;
@@ -710,21 +1102,24 @@ BodyPart* genCreatureRec(
 		int c_partlen = creature->body.size();
 		BodyPart* tmp = genCreatureRec(
 			genes, 
+			marks,
 			creature, 
 			edge.target, 
 			npose, 
 			scale * edge.scale,
-			reflect * edge.reflect);
+			reflect * edge.reflect,
+			verbose);
 		
 		//If failed, then skip it
 		if(tmp == NULL)
 		{
-			cout << "Failed to create body part" << endl;
+			if(verbose)
+				cout << "Failed to create body part" << endl;
 		
-			edge.marked = false;
+			marks.mark(n, i, false);
 			
 			for(int i=c_partlen; i<(int)creature->body.size(); i++)
-				delete creature->body[i];			
+				creature->release_part(creature->body[i]);
 			creature->body.resize(c_partlen);
 			continue;
 		}
@@ -758,7 +1153,7 @@ BodyPart* genCreatureRec(
 		joint_desc.localAxis[1] =		edge.t_axis;
 		joint_desc.localNormal[1] = 	edge.t_norm;
 		
-	    NxJoint * joint = scene->createJoint(joint_desc);
+	    NxJoint * joint = creature->scene->createJoint(joint_desc);
 	    
 	    /*
 	    
@@ -785,110 +1180,64 @@ BodyPart* genCreatureRec(
 	    
 	    if(joint == NULL)
 	    {
-	    	cout << "Failed to create joint!" << endl;
-	    	delete tmp;
-	    	edge.marked = false;
+	    	if(verbose)
+	    		cout << "Failed to create joint!" << endl;
+	    	creature->release_part(tmp);
+	    	marks.mark(n, i, false);
 	    	
 			for(int i=c_partlen+1; i<(int)creature->body.size(); i++)
-				delete creature->body[i];			
+				creature->release_part(creature->body[i]);
 			creature->body.resize(c_partlen);
 			
 	    	continue;
 	    }
 	   	else
 	   	{
-	    	res->attachPart(tmp, joint, 10.f);	//TODO: Adjust strength calculation here
+	    	res->attachPart(tmp, joint, 10.f);	//TODO: Adjust strength calculation here
 		}
 		
 		//Unmark used edge
-	 	edge.marked = false;
+	 	marks.mark(n, i, false);
 	}
 	
 	//Rig up wires
-	for(int i=0; i<(int)node.gates.size(); i++)
-	{
-		for(int j=0; j<(int)node.gates[i].wires.size(); j++)
-		{
-			GateEdge ge = node.gates[i].wires[j];
-			
-			//Hard part: need to find target gate
-			BodyPart* container;
-			switch(ge.node_type)
-			{
-				case NODE_CURRENT:
-					container = res;
-				break;
-				case NODE_CHILD:
-				
-					if(res->limbs.size() > 0)
-						container = res->limbs[ge.node % res->limbs.size()];
-					else
-						container = res;
-				break;
-				
-				default: assert(false);
-			}
-			
-			Gate * a = res->controls[i];
-			Gate* b = a;
-			switch(ge.gate_type)
-			{
-				case GATE_SENSOR:
-				if(container->sensors.size() > 0)
-				{	b = container->sensors[ge.gate % container->sensors.size()];
-					break;
-				}
-				case GATE_EFFECTOR:
-				if(container->effectors.size() > 0)
-				{	b = container->effectors[ge.gate % container->effectors.size()];
-					break;
-				}
-
-				case GATE_CONTROL:
-				if(container->controls.size() > 0)
-					b = container->controls[ge.gate % container->controls.size()];
-				break;
-				
-				default: assert(false);
-			}
-			
-			//Get default gate
-			if(ge.direction > 0)
-				swap(a, b);
-
-			//Add wire
-			Wire * wire = new Wire();
-			res->wires.push_back(wire);
-			
-			//Connect gates
-			a->outputs.push_back(wire);
-			b->inputs.push_back(wire);
-		}
-	}
+	rigWires(node, res);
 	
 	
 	return res;
 }
 
 
+//Constructs a creature in the default scene
+Creature* Genotype::createCreature(NxMat34 pose) const
+{
+	return createCreature(Common::scene, pose);
+}
+
 //Constructs a creature from the genotype
-Creature* Genotype::createCreature(NxMat34 pose)
+Creature* Genotype::createCreature(NxScene* scene, NxMat34 pose, NxCollisionGroup group, bool verbose) const
 {
-	Creature* res = new Creature();
+	Creature* res = new Creature(scene, group);
 
 	//Generate a body schema
-	BodyPart* b = genCreatureRec(*this, res, root, pose, 1., 1.);
+	EdgeMarks marks(*this);
+	BodyPart* b = genCreatureRec(*this, marks, res, root, pose, 1., 1., verbose);
 	
 	//Check for failure
 	if(b == NULL)
 	{
-		cout << "Creature build fail!" << endl;
+		if(verbose)
+			cout << "Creature build fail!" << endl;
 		delete res;
 		return NULL;
 	}
 	
 	//Attach root and done
 	res->root = b;
+	
+	if(compile_circuits)
+		res->compile();
+	
 	return res;
 }
 
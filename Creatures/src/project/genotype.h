@@ -3,6 +3,7 @@
 
 
 #include "common/sys_includes.h"
+#include "common/shared.h"
 #include "project/creature.h"
 #include "project/circuit.h"
 
@@ -13,6 +14,7 @@ namespace Game
 {
 
 using namespace std;
+using Common::SharedVector;
 
 enum NodeType
 {
@@ -42,7 +44,7 @@ struct GateEdge
 	void save(ostream& os) const;
 	static GateEdge load(istream& is);
 	
-	void normalize(struct Genotype& genes, int n, int g);
+	void normalize(const struct Genotype& genes, int n, int g);
 };
 
 //A circuit node
@@ -50,7 +52,9 @@ struct GateNode
 {
 	//An internal node
 	vector<float>	params;
-	string			name;
+	int				id;			//Gate type, see gateId()
+	
+	GateNode() : id(UNKNOWN_GATE) {}
 	
 	//Serialization
 	void save(ostream& os) const;
@@ -60,14 +64,15 @@ struct GateNode
 	vector<GateEdge>	wires;
 	
 	void normalize();
+	
+	//True if normalize() would leave the gate as it is.  scratch is just
+	//working space, so a caller can reuse it across gates.
+	bool is_normal(vector<float>& scratch) const;
 };
 
 //A link between two phenotypes
 struct Edge
 {
-	//If true, edge is active
-	bool marked;
-
 	//Number of times this edge may be traversed
 	int source, target;
 	
@@ -82,16 +87,13 @@ struct Edge
 			s_point, t_point;
 
 	float stiffness, strength;
-			
-	//Constructor
-	Edge() : marked(false) {}	
 
 	//Serialization
 	void save(ostream& os) const;
 	static Edge load(istream& is);
 	
 	//Normalizes the edge
-	void normalize(struct Genotype& gen);
+	void normalize(const struct Genotype& gen);
 };
 
 //Generates some body part
@@ -112,26 +114,73 @@ struct Node
 	static Node load(istream& is);
 	
 	//Gets the closest point to the surface of this body
-	NxVec3 closest_pt(const NxVec3& x);
+	NxVec3 closest_pt(const NxVec3& x) const;
 	
-	//Normalizes the genes
+	//Normalizes the genes, leaves the gates alone
 	void normalize();
 	
+	//Compares everything but the gates
+	bool same_body(const Node& other) const;
+	
 	//Control circuits associated to this particular body part.
-	vector<GateNode> gates;
+	SharedVector<GateNode> gates;
 };
 
 
+//Parts of a genotype which were edited since it was last normalized.
+//
+//	Gates and wires are listed one by one, the rest is flagged per node.
+//	BODY: the node's shape or size.  SHAPE: the number of gates or edges the
+//	node has, which its own wires and the wires pointing at it depend on.
+//	EDGES: its list of outgoing edges.  Anything which changes the number of
+//	nodes has to use mark_all().  Listed gates and wires must still be at
+//	the same index when the genes are normalized.
+struct DirtySet
+{
+	enum
+	{
+		BODY	= 1,
+		SHAPE	= 2,
+		EDGES	= 4,
+	};
+	
+	DirtySet() : all(false), any(0) {}
+	
+	void mark(int n, int what)
+	{
+		if(n >= (int)flags.size())
+			flags.resize(n + 1, 0);
+		flags[n] |= what;
+		any |= what;
+	}
+	void mark_gate(int n, int g) { gates.push_back(make_pair(n, g)); }
+	void mark_wire(int n, int g, int w) { wires.push_back(make_pair(n, make_pair(g, w))); }
+	void mark_all() { all = true; }
+	
+	int get(int n) const { return n >= 0 && n < (int)flags.size() ? flags[n] : 0; }
+	
+	bool								all;
+	int									any;	//Union of all the flags
+	vector<unsigned char>				flags;
+	vector< pair<int,int> >				gates;	//(node, gate)
+	vector< pair<int, pair<int,int> > >	wires;	//(node, (gate, wire))
+};
+
 //A creature phenotype
+//
+//	Nodes, their gates and the edge lists are shared between copies of a
+//	genotype, so copying one is cheap.  Read through operator[], and go
+//	through edit() for anything which changes the genes; that copies only
+//	the part being changed.
 struct Genotype
 {
 	//Phenotype graph
-	int						root;
-	vector<Node>			nodes;
-	vector< vector<Edge> >	edges;
+	int								root;
+	SharedVector<Node>				nodes;
+	SharedVector< vector<Edge> >	edges;
 	
 	//Constructors
-	Genotype() : root(0), nodes(0), edges(0) {}
+	Genotype() : root(0) {}
 	Genotype(const Genotype& t) : root(t.root), nodes(t.nodes), edges(t.edges) {}
 	
 	Genotype operator=(const Genotype& t)
@@ -145,25 +194,60 @@ struct Genotype
 	//Graph modification stuff
 	void remove_node(int n);
 	void remove_edge(int s, int t);
-	void remove_gate(int n, int g);
+	void remove_gate(int n, int g, DirtySet* dirty = NULL);
 	void remove_wire(int n, int g, int w);
 	
+	//Strips control gates and wires which can't reach a joint effector in
+	//any creature built from the genes, see genotype.cpp.  Creatures built
+	//before and after move the same way.  Normal genes stay normal.
+	//Returns the number of gates and wires removed.
+	int prune();
+	
+	//Number of gates and wires in the control circuits
+	int circuit_size() const;
+	
 	//Save/load phenotypes from file
 	void save(ostream& os) const;
 	static Genotype load(istream& is);
 	
-	//Generates a creature from this graph
-	Creature* createCreature(NxMat34 pose);
-	Creature* createCreature() { NxMat34 tmp; tmp.id(); return createCreature(tmp); }
+	//Generates a creature from this graph, failures are reported on cout
+	//if verbose
+	Creature* createCreature(NxScene* scene, NxMat34 pose, NxCollisionGroup group = 0, bool verbose = true) const;
+	Creature* createCreature(NxMat34 pose) const;
+	Creature* createCreature() const { NxMat34 tmp; tmp.id(); return createCreature(tmp); }
 	
+	//Brings every gene back in bounds, for genes of unknown origin such as
+	//a loaded file
 	void normalize();
 	
+	//Same result, but only revisits what dirty marks and what depends on
+	//it.  The genes must have been normal before the marked edits.
+	void normalize(const DirtySet& dirty);
+	
 	bool operator<(const Genotype& other) const
 	{
 		return false;
 	}
 };
 
+//Edges on the path being unfolded, so that cycles in the graph terminate.
+//Kept outside of the genotype so that building a creature never writes to it.
+struct EdgeMarks
+{
+	EdgeMarks(const Genotype& genes);
+	
+	bool marked(int n, int e) const { return marks[first[n] + e] != 0; }
+	void mark(int n, int e, bool m) { marks[first[n] + e] = m; }
+	
+private:
+	vector<int>		first;
+	vector<char>	marks;
+};
+
+//Circuit construction helpers, shared by createCreature and the pre-screen
+void createGates(const Node& node, BodyPart* res);
+void rigWires(const Node& node, BodyPart* res);
+
 };
 
 
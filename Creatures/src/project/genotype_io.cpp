@@ -0,0 +1,355 @@
+#include <vector>
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <algorithm>
+
+#include "common/sys_includes.h"
+
+#include "project/genotype.h"
+#include "project/genotype_io.h"
+
+using namespace std;
+
+namespace Game
+{
+
+static void put_vec(float* dst, const NxVec3& v)
+{
+	dst[0] = v.x;
+	dst[1] = v.y;
+	dst[2] = v.z;
+}
+
+static NxVec3 get_vec(const float* src)
+{
+	return NxVec3(src[0], src[1], src[2]);
+}
+
+//Size of a blob with the given header
+static size_t blob_size(const BinaryHeader& h)
+{
+	return	sizeof(BinaryHeader) +
+			h.num_nodes		* sizeof(NodeRecord) +
+			h.num_edges		* sizeof(EdgeRecord) +
+			h.num_gates		* sizeof(GateRecord) +
+			h.num_wires		* sizeof(WireRecord) +
+			h.num_params	* sizeof(float);
+}
+
+//Advances through a blob, checking that the next array fits
+static const char* take(const char*& ptr, const char* end, size_t count, size_t elem)
+{
+	if(count > (size_t)(end - ptr) / elem)
+		throw "Truncated genotype";
+	const char* res = ptr;
+	ptr += count * elem;
+	return res;
+}
+
+
+GenotypeView::GenotypeView(const char* data, size_t size)
+{
+	const char* ptr = data;
+	const char* end = data + size;
+	
+	header = (const BinaryHeader*)take(ptr, end, 1, sizeof(BinaryHeader));
+	if(header->magic != GENOTYPE_MAGIC)
+		throw "Not a binary genotype";
+	if(header->byte_order != BYTE_ORDER_MARK)
+		throw "Binary genotype has the wrong byte order";
+	if(header->version != GENOTYPE_VERSION)
+		throw "Unsupported binary genotype version";
+	
+	nodes	= (const NodeRecord*)take(ptr, end, header->num_nodes, sizeof(NodeRecord));
+	edges	= (const EdgeRecord*)take(ptr, end, header->num_edges, sizeof(EdgeRecord));
+	gates	= (const GateRecord*)take(ptr, end, header->num_gates, sizeof(GateRecord));
+	wires	= (const WireRecord*)take(ptr, end, header->num_wires, sizeof(WireRecord));
+	params	= (const float*)take(ptr, end, header->num_params, sizeof(float));
+}
+
+size_t GenotypeView::size() const
+{
+	return blob_size(*header);
+}
+
+//Rebuilds the nested genotype structure from the flat arrays
+Genotype GenotypeView::unpack() const
+{
+	int n_nodes = header->num_nodes;
+	if(header->root < 0 || header->root >= n_nodes)
+		throw "Invalid root node";
+
+	Genotype res;
+	res.root = header->root;
+	res.nodes.resize(n_nodes);
+	res.edges.resize(n_nodes);
+	
+	for(int i=0; i<n_nodes; i++)
+	{
+		const NodeRecord& nr = nodes[i];
+		Node& node = res.nodes.edit(i);
+		
+		node.color	= get_vec(nr.color);
+		node.shape	= (BodyPartType)nr.shape;
+		node.size	= get_vec(nr.size);
+		node.radius	= nr.radius;
+		node.length	= nr.length;
+		
+		if(nr.first_gate > header->num_gates ||
+			nr.num_gates > header->num_gates - nr.first_gate)
+			throw "Invalid gate range";
+		
+		node.gates.resize(nr.num_gates);
+		for(int j=0; j<(int)nr.num_gates; j++)
+		{
+			const GateRecord& gr = gates[nr.first_gate + j];
+			GateNode& gate = node.gates.edit(j);
+			
+			int len = 0;
+			while(len < GATE_NAME_LENGTH && gr.name[len] != 0)
+				len++;
+			gate.id = gateId(string(gr.name, len));
+			
+			if(gr.first_param > header->num_params ||
+				gr.num_params > header->num_params - gr.first_param)
+				throw "Invalid parameter range";
+			gate.params.assign(
+				params + gr.first_param,
+				params + gr.first_param + gr.num_params);
+			
+			if(gr.first_wire > header->num_wires ||
+				gr.num_wires > header->num_wires - gr.first_wire)
+				throw "Invalid wire range";
+			gate.wires.resize(gr.num_wires);
+			for(int k=0; k<(int)gr.num_wires; k++)
+			{
+				const WireRecord& wr = wires[gr.first_wire + k];
+				GateEdge& w = gate.wires[k];
+				w.node_type	= (NodeType)wr.node_type;
+				w.node		= wr.node;
+				w.gate_type	= (GateType)wr.gate_type;
+				w.gate		= wr.gate;
+				w.direction	= wr.direction;
+			}
+		}
+		
+		if(nr.first_edge > header->num_edges ||
+			nr.num_edges > header->num_edges - nr.first_edge)
+			throw "Invalid edge range";
+		
+		vector<Edge>& list = res.edges.edit(i);
+		list.resize(nr.num_edges);
+		for(int j=0; j<(int)nr.num_edges; j++)
+		{
+			const EdgeRecord& er = edges[nr.first_edge + j];
+			Edge& e = list[j];
+			
+			if(er.source != i || er.target < 0 || er.target >= n_nodes)
+				throw "Invalid edge";
+			
+			e.source	= er.source;
+			e.target	= er.target;
+			e.rot.w		= er.rot[0];
+			e.rot.x		= er.rot[1];
+			e.rot.y		= er.rot[2];
+			e.rot.z		= er.rot[3];
+			e.scale		= er.scale;
+			e.reflect	= er.reflect;
+			e.s_point	= get_vec(er.s_point);
+			e.t_point	= get_vec(er.t_point);
+			e.s_axis	= get_vec(er.s_axis);
+			e.t_axis	= get_vec(er.t_axis);
+			e.s_norm	= get_vec(er.s_norm);
+			e.t_norm	= get_vec(er.t_norm);
+			e.strength	= er.strength;
+			e.stiffness	= er.stiffness;
+		}
+	}
+	
+	//Same clean up as the text format
+	res.normalize();
+	
+	return res;
+}
+
+//Fills in the header counts for a genotype
+static BinaryHeader make_header(const Genotype& genes)
+{
+	BinaryHeader h;
+	h.magic			= GENOTYPE_MAGIC;
+	h.version		= GENOTYPE_VERSION;
+	h.byte_order	= BYTE_ORDER_MARK;
+	h.root			= genes.root;
+	h.num_nodes		= genes.nodes.size();
+	h.num_edges		= 0;
+	h.num_gates		= 0;
+	h.num_wires		= 0;
+	h.num_params	= 0;
+	
+	for(int i=0; i<(int)genes.nodes.size(); i++)
+	{
+		const Node& node = genes.nodes[i];
+		h.num_edges += genes.edges[i].size();
+		h.num_gates += node.gates.size();
+		for(int j=0; j<(int)node.gates.size(); j++)
+		{
+			h.num_wires += node.gates[j].wires.size();
+			h.num_params += node.gates[j].params.size();
+		}
+	}
+	return h;
+}
+
+size_t binary_size(const Genotype& genes)
+{
+	return blob_size(make_header(genes));
+}
+
+//Flattens the genotype into record arrays and writes them out
+void save_binary(const Genotype& genes, ostream& os)
+{
+	BinaryHeader h = make_header(genes);
+	
+	vector<NodeRecord>	nodes(h.num_nodes);
+	vector<EdgeRecord>	edges(h.num_edges);
+	vector<GateRecord>	gates(h.num_gates);
+	vector<WireRecord>	wires(h.num_wires);
+	vector<float>		params;
+	params.reserve(h.num_params);
+	
+	int ne = 0, ng = 0, nw = 0;
+	for(int i=0; i<(int)genes.nodes.size(); i++)
+	{
+		const Node& node = genes.nodes[i];
+		NodeRecord& nr = nodes[i];
+		
+		put_vec(nr.color, node.color);
+		nr.shape	= node.shape;
+		put_vec(nr.size, node.size);
+		nr.radius	= node.radius;
+		nr.length	= node.length;
+		
+		nr.first_gate	= ng;
+		nr.num_gates	= node.gates.size();
+		for(int j=0; j<(int)node.gates.size(); j++)
+		{
+			const GateNode& gate = node.gates[j];
+			GateRecord& gr = gates[ng++];
+			
+			const string& name = gateName(gate.id);
+			if(name.size() >= (size_t)GATE_NAME_LENGTH)
+				throw "Gate name too long: " + name;
+			memset(gr.name, 0, sizeof(gr.name));
+			memcpy(gr.name, name.data(), name.size());
+			
+			gr.first_param	= params.size();
+			gr.num_params	= gate.params.size();
+			params.insert(params.end(), gate.params.begin(), gate.params.end());
+			
+			gr.first_wire	= nw;
+			gr.num_wires	= gate.wires.size();
+			for(int k=0; k<(int)gate.wires.size(); k++)
+			{
+				const GateEdge& w = gate.wires[k];
+				WireRecord& wr = wires[nw++];
+				wr.node_type	= w.node_type;
+				wr.node			= w.node;
+				wr.gate_type	= w.gate_type;
+				wr.gate			= w.gate;
+				wr.direction	= w.direction;
+			}
+		}
+		
+		nr.first_edge	= ne;
+		nr.num_edges	= genes.edges[i].size();
+		for(int j=0; j<(int)genes.edges[i].size(); j++)
+		{
+			const Edge& e = genes.edges[i][j];
+			EdgeRecord& er = edges[ne++];
+			
+			er.source		= e.source;
+			er.target		= e.target;
+			er.rot[0]		= e.rot.w;
+			er.rot[1]		= e.rot.x;
+			er.rot[2]		= e.rot.y;
+			er.rot[3]		= e.rot.z;
+			er.scale		= e.scale;
+			er.reflect		= e.reflect;
+			put_vec(er.s_point, e.s_point);
+			put_vec(er.t_point, e.t_point);
+			put_vec(er.s_axis, e.s_axis);
+			put_vec(er.t_axis, e.t_axis);
+			put_vec(er.s_norm, e.s_norm);
+			put_vec(er.t_norm, e.t_norm);
+			er.strength		= e.strength;
+			er.stiffness	= e.stiffness;
+		}
+	}
+	
+	os.write((const char*)&h, sizeof(h));
+	if(nodes.size() > 0)
+		os.write((const char*)&nodes[0], nodes.size() * sizeof(NodeRecord));
+	if(edges.size() > 0)
+		os.write((const char*)&edges[0], edges.size() * sizeof(EdgeRecord));
+	if(gates.size() > 0)
+		os.write((const char*)&gates[0], gates.size() * sizeof(GateRecord));
+	if(wires.size() > 0)
+		os.write((const char*)&wires[0], wires.size() * sizeof(WireRecord));
+	if(params.size() > 0)
+		os.write((const char*)&params[0], params.size() * sizeof(float));
+}
+
+Genotype load_binary(const char* data, size_t size)
+{
+	return GenotypeView(data, size).unpack();
+}
+
+//Reads the header to find the size, then slurps the rest of the blob
+Genotype load_binary(istream& is)
+{
+	vector<char> buf(sizeof(BinaryHeader));
+	if(!is.read(&buf[0], buf.size()))
+		throw "Truncated genotype";
+	
+	//Only the header is present at this point, the view just checks it
+	const BinaryHeader* h = (const BinaryHeader*)&buf[0];
+	if(h->magic != GENOTYPE_MAGIC || h->byte_order != BYTE_ORDER_MARK)
+		throw "Not a binary genotype";
+	
+	//The counts aren't checked yet, so the buffer only grows as fast as
+	//the stream delivers and a bogus header can't ask for gigabytes
+	const size_t CHUNK = 1 << 16;
+	size_t size = blob_size(*h);
+	while(buf.size() < size)
+	{
+		size_t done = buf.size();
+		buf.resize(done + min(CHUNK, size - done));
+		if(!is.read(&buf[done], buf.size() - done))
+			throw "Truncated genotype";
+	}
+	
+	return load_binary(&buf[0], buf.size());
+}
+
+void text_to_binary(istream& is, ostream& os)
+{
+	save_binary(Genotype::load(is), os);
+}
+
+void binary_to_text(istream& is, ostream& os)
+{
+	load_binary(is).save(os);
+}
+
+bool is_binary(istream& is)
+{
+	NxU32 magic = 0;
+	streampos pos = is.tellg();
+	is.read((char*)&magic, sizeof(magic));
+	is.clear();
+	is.seekg(pos);
+	return magic == GENOTYPE_MAGIC;
+}
+
+};
@@ -0,0 +1,118 @@
+#ifndef GENOTYPE_IO_H
+#define GENOTYPE_IO_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "common/sys_includes.h"
+#include "project/genotype.h"
+
+namespace Game
+{
+
+//Binary genotype format
+//
+//	A binary genotype is a header followed by flat arrays of fixed size
+//	records, in this order:
+//
+//		BinaryHeader
+//		NodeRecord	[num_nodes]
+//		EdgeRecord	[num_edges]		grouped by source node
+//		GateRecord	[num_gates]		grouped by node
+//		WireRecord	[num_wires]		grouped by gate
+//		float		[num_params]	grouped by gate
+//
+//	Every field is 4 bytes wide, so a blob which starts on a 4 byte boundary
+//	(e.g. straight out of mmap) can be read in place through a GenotypeView.
+
+const NxU32 GENOTYPE_MAGIC		= 0x424e4547;	//"GENB"
+const NxU32 GENOTYPE_VERSION	= 1;
+const NxU32 BYTE_ORDER_MARK		= 0x01020304;
+
+const int GATE_NAME_LENGTH		= 16;
+
+struct BinaryHeader
+{
+	NxU32	magic;
+	NxU32	version;
+	NxU32	byte_order;
+	NxI32	root;
+	NxU32	num_nodes, num_edges, num_gates, num_wires, num_params;
+};
+
+struct NodeRecord
+{
+	float	color[3];
+	NxI32	shape;
+	float	size[3];
+	float	radius, length;
+	NxU32	first_gate, num_gates;
+	NxU32	first_edge, num_edges;
+};
+
+struct EdgeRecord
+{
+	NxI32	source, target;
+	float	rot[4];			//w, x, y, z
+	float	scale;
+	NxI32	reflect;
+	float	s_point[3], t_point[3],
+			s_axis[3],  t_axis[3],
+			s_norm[3],  t_norm[3];
+	float	strength, stiffness;
+};
+
+struct GateRecord
+{
+	char	name[GATE_NAME_LENGTH];		//Zero padded
+	NxU32	first_param, num_params;
+	NxU32	first_wire, num_wires;
+};
+
+struct WireRecord
+{
+	NxI32	node_type, node, gate_type, gate, direction;
+};
+
+//Read only view of a binary genotype, no copying or parsing
+struct GenotypeView
+{
+	//Checks the header and sizes, throws on a malformed blob
+	GenotypeView(const char* data, size_t size);
+	
+	const BinaryHeader*	header;
+	const NodeRecord*	nodes;
+	const EdgeRecord*	edges;
+	const GateRecord*	gates;
+	const WireRecord*	wires;
+	const float*		params;
+	
+	//Total size of the blob in bytes
+	size_t size() const;
+	
+	//Unpacks into a regular genotype, normalized like Genotype::load()
+	//so unknown gates and stray wire fields can't reach createCreature()
+	Genotype unpack() const;
+};
+
+//Size of the binary encoding of a genotype
+size_t binary_size(const Genotype& genes);
+
+//Binary serialization
+void save_binary(const Genotype& genes, std::ostream& os);
+Genotype load_binary(const char* data, size_t size);
+Genotype load_binary(std::istream& is);
+
+//Converters between the text .dna format and the binary format
+void text_to_binary(std::istream& is, std::ostream& os);
+void binary_to_text(std::istream& is, std::ostream& os);
+
+//Returns true if the stream starts with a binary genotype, doesn't consume anything
+bool is_binary(std::istream& is);
+
+};
+
+#endif
+
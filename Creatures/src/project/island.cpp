@@ -0,0 +1,149 @@
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "common/sys_includes.h"
+
+#include "project/island.h"
+#include "project/population.h"
+
+using namespace std;
+
+namespace Game
+{
+
+void save_migrants(const Migrants& migrants, ostream& os)
+{
+	NxU32 count = migrants.size();
+	os.write((const char*)&count, sizeof(count));
+	for(int i=0; i<(int)migrants.size(); i++)
+		save_species_entry(migrants[i], os);
+}
+
+void load_migrants(const char* data, size_t size, Migrants& migrants)
+{
+	if(size < sizeof(NxU32))
+		throw "Truncated migrants";
+
+	NxU32 count;
+	memcpy(&count, data, sizeof(count));
+
+	const char* ptr = data + sizeof(count);
+	const char* end = data + size;
+
+	Migrants m;
+	for(int i=0; i<(int)count; i++)
+		m.push_back(load_species_entry(ptr, end));
+	migrants.swap(m);
+}
+
+PipeChannel::PipeChannel(int in_fd_, int out_fd_) :
+	in_fd(in_fd_),
+	out_fd(out_fd_),
+	closed(false)
+{
+	fcntl(out_fd, F_SETFL, fcntl(out_fd, F_GETFL) | O_NONBLOCK);
+}
+
+PipeChannel::~PipeChannel()
+{
+	//Nobody is going to read from us any more, so just wait for the pipe
+	fcntl(out_fd, F_SETFL, fcntl(out_fd, F_GETFL) & ~O_NONBLOCK);
+	while(outbox.size() > 0)
+	{
+		size_t before = outbox.size();
+		flush_some();
+		if(outbox.size() == before)
+			break;
+	}
+
+	::close(in_fd);
+	::close(out_fd);
+}
+
+void PipeChannel::send(const Migrants& migrants)
+{
+	ostringstream buf;
+	save_migrants(migrants, buf);
+	string msg = buf.str();
+
+	NxU32 size = msg.size();
+	outbox.append((const char*)&size, sizeof(size));
+	outbox.append(msg);
+	flush_some();
+}
+
+//Drops the outbox if the reader is gone, the driver ignores SIGPIPE
+void PipeChannel::flush_some()
+{
+	while(outbox.size() > 0)
+	{
+		ssize_t n = ::write(out_fd, outbox.data(), outbox.size());
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			if(errno != EAGAIN && errno != EWOULDBLOCK)
+				outbox.clear();
+			return;
+		}
+		outbox.erase(0, n);
+	}
+}
+
+bool PipeChannel::receive(Migrants& migrants)
+{
+	while(true)
+	{
+		//Is there a whole message yet?
+		if(inbox.size() >= sizeof(NxU32))
+		{
+			NxU32 size;
+			memcpy(&size, inbox.data(), sizeof(size));
+			if(inbox.size() >= sizeof(NxU32) + size)
+			{
+				load_migrants(inbox.data() + sizeof(NxU32), size, migrants);
+				inbox.erase(0, sizeof(NxU32) + size);
+				return true;
+			}
+		}
+		if(closed)
+			return false;
+
+		//Keep our own migrants moving while we wait, the next island may be
+		//blocked on them
+		pollfd fds[2];
+		fds[0].fd		= in_fd;
+		fds[0].events	= POLLIN;
+		fds[1].fd		= out_fd;
+		fds[1].events	= POLLOUT;
+		int num_fds = outbox.size() > 0 ? 2 : 1;
+		if(poll(fds, num_fds, -1) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+
+		if(num_fds > 1 && (fds[1].revents & (POLLOUT | POLLERR | POLLHUP)))
+			flush_some();
+
+		if(fds[0].revents & (POLLIN | POLLERR | POLLHUP))
+		{
+			char buf[65536];
+			ssize_t n = ::read(in_fd, buf, sizeof(buf));
+			if(n < 0 && errno != EINTR && errno != EAGAIN)
+				closed = true;
+			else if(n == 0)
+				closed = true;
+			else if(n > 0)
+				inbox.append(buf, n);
+		}
+	}
+}
+
+};
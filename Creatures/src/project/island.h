@@ -0,0 +1,69 @@
+#ifndef ISLAND_H
+#define ISLAND_H
+
+#include <vector>
+#include <string>
+#include <utility>
+
+#include "project/genotype.h"
+
+namespace Game
+{
+
+//A batch of genotypes sent from one island to the next, best first
+typedef vector< pair<float,Genotype> > Migrants;
+
+//One island's link to its neighbours in the ring
+//
+//	Every island calls send() and then receive() at the same generations, so
+//	send() must never wait on the other end.  Anything which implements this
+//	can stand in for the pipes, e.g. a queue in a test.
+struct MigrationChannel
+{
+	virtual ~MigrationChannel() {}
+
+	//Queues migrants for the next island
+	virtual void send(const Migrants& migrants) = 0;
+
+	//Waits for migrants from the previous island, returns false once the
+	//other end has gone away
+	virtual bool receive(Migrants& migrants) = 0;
+};
+
+//Migration over a pair of pipe (or socket) file descriptors
+//
+//	Each message is an NxU32 byte count followed by the migrants in the same
+//	entry format as a population file.  Writes never block: whatever the pipe
+//	won't take yet is kept and pushed out while waiting in receive(), so a
+//	ring of islands which all send before they receive can't deadlock.  The
+//	channel owns both descriptors.
+struct PipeChannel : public MigrationChannel
+{
+	PipeChannel(int in_fd, int out_fd);
+
+	//Blocks until everything queued has been written, then closes the pipes
+	virtual ~PipeChannel();
+
+	virtual void send(const Migrants& migrants);
+	virtual bool receive(Migrants& migrants);
+
+private:
+	//Writes as much of outbox as the pipe will take
+	void flush_some();
+
+	int			in_fd, out_fd;
+	string		inbox, outbox;
+	bool		closed;
+
+	//Not copyable, owns the descriptors
+	PipeChannel(const PipeChannel&);
+	PipeChannel& operator=(const PipeChannel&);
+};
+
+//Migrant wire format
+void save_migrants(const Migrants& migrants, ostream& os);
+void load_migrants(const char* data, size_t size, Migrants& migrants);
+
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cmath>
 
 #include "common/sys_includes.h"
 
@@ -6,6 +7,8 @@
 #include "project/genotype.h"
 #include "project/mutation.h"
 
+using Common::Random;
+
 namespace Game
 {
 
@@ -23,367 +26,562 @@ const double WIRE_KILL_RATE 	= 0.008;
 
 const double ROOT_RELOC_RATE	= 0.001;
 
-float nrand(int x = 5)
+float nrand(Random& rng, int x = 5)
 {
 	float s = 0;
 	for(int i=0; i<x; i++)
-		s += drand48() - .5;
+		s += rng.uniform() - .5;
 	return s;
 }
 
-NxVec3 rand_vec(int x = 5)
+NxVec3 rand_vec(Random& rng, int x = 5)
 {
-	return NxVec3(nrand(x), nrand(x), nrand(x));
+	return NxVec3(nrand(rng, x), nrand(rng, x), nrand(rng, x));
 }
 
-NxQuat rand_quat(int x = 5)
+NxQuat rand_quat(Random& rng, int x = 5)
 {
-	NxVec3 rv = rand_vec(x);
+	NxVec3 rv = rand_vec(rng, x);
 	rv.normalize();
 	
 	NxQuat rq;
-	rq.fromAngleAxis(nrand(x)*180., rv);
+	rq.fromAngleAxis(nrand(rng, x)*180., rv);
 	return rq;
 }
 
-void perturb_node(Node& n)
+//The genes are shared with the parent, so each perturbation asks for a
+//writable copy only once a mutation actually fires.  Asking for one also
+//marks the part dirty, so that only edited parts are normalized again.
+
+Node& edit_node(Genotype& g, int i, DirtySet& dirty)
+{
+	dirty.mark(i, DirtySet::BODY);
+	return g.nodes.edit(i);
+}
+
+void perturb_node(Genotype& g, int i, DirtySet& dirty, Random& rng)
 {
-	if(drand48() < MUTATION_RATE)
-		n.color = rand_vec() + 0.3 * n.color;
-	if(drand48() < MUTATION_RATE)
-		n.size += rand_vec();
-	if(drand48() < MUTATION_RATE)
-		n.radius += nrand();
-	if(drand48() < MUTATION_RATE)
-		n.length += nrand();
+	if(rng.uniform() < MUTATION_RATE)
+	{
+		NxVec3 r = rand_vec(rng);
+		Node& n = edit_node(g, i, dirty);
+		n.color = r + 0.3 * n.color;
+	}
+	if(rng.uniform() < MUTATION_RATE)
+		edit_node(g, i, dirty).size += rand_vec(rng);
+	if(rng.uniform() < MUTATION_RATE)
+		edit_node(g, i, dirty).radius += nrand(rng);
+	if(rng.uniform() < MUTATION_RATE)
+		edit_node(g, i, dirty).length += nrand(rng);
 }
 
-void perturb_edge(Genotype& g, int s, int x)
+Edge& edit_edge(Genotype& g, int s, int x, DirtySet& dirty)
 {
-	Edge& e = g.edges[s][x];
+	dirty.mark(s, DirtySet::EDGES);
+	return g.edges.edit(s)[x];
+}
 
-	if(drand48() < MUTATION_RATE)
+void perturb_edge(Genotype& g, int s, int x, DirtySet& dirty, Random& rng)
+{
+	if(rng.uniform() < MUTATION_RATE)
 	{
-		e.rot *= rand_quat();
+		NxQuat q = rand_quat(rng);
+		Edge& e = edit_edge(g, s, x, dirty);
+		e.rot *= q;
 		e.rot.normalize();
 	}
 	
-	if(drand48() < MUTATION_RATE)
-		e.scale *= (2.5 + nrand()) / 2.5;
-
-	if(drand48() < MUTATION_RATE)
-		e.reflect *= -1;
-	
-	if(drand48() < MUTATION_RATE)
-		e.s_axis += rand_vec();
-	if(drand48() < MUTATION_RATE)
-		e.s_norm += rand_vec();
-	if(drand48() < MUTATION_RATE)
-		e.s_point += rand_vec() * 5;
-
-	if(drand48() < MUTATION_RATE)
-		e.t_axis += rand_vec();
-	if(drand48() < MUTATION_RATE)
-		e.t_norm += rand_vec();
-	if(drand48() < MUTATION_RATE)
-		e.t_point += rand_vec() * 5;
+	if(rng.uniform() < MUTATION_RATE)
+		edit_edge(g, s, x, dirty).scale *= (2.5 + nrand(rng)) / 2.5;
+
+	if(rng.uniform() < MUTATION_RATE)
+		edit_edge(g, s, x, dirty).reflect *= -1;
+	
+	if(rng.uniform() < MUTATION_RATE)
+		edit_edge(g, s, x, dirty).s_axis += rand_vec(rng);
+	if(rng.uniform() < MUTATION_RATE)
+		edit_edge(g, s, x, dirty).s_norm += rand_vec(rng);
+	if(rng.uniform() < MUTATION_RATE)
+		edit_edge(g, s, x, dirty).s_point += rand_vec(rng) * 5;
+
+	if(rng.uniform() < MUTATION_RATE)
+		edit_edge(g, s, x, dirty).t_axis += rand_vec(rng);
+	if(rng.uniform() < MUTATION_RATE)
+		edit_edge(g, s, x, dirty).t_norm += rand_vec(rng);
+	if(rng.uniform() < MUTATION_RATE)
+		edit_edge(g, s, x, dirty).t_point += rand_vec(rng) * 5;
 		
-	if(drand48() < MUTATION_RATE)
-		e.target = rand() % g.nodes.size();
+	if(rng.uniform() < MUTATION_RATE)
+		edit_edge(g, s, x, dirty).target = rng.below(g.nodes.size());
 	
-	if(drand48() < MUTATION_RATE)
-		e.strength += nrand() * 20.;
+	if(rng.uniform() < MUTATION_RATE)
+		edit_edge(g, s, x, dirty).strength += nrand(rng) * 20.;
 	
-	if(drand48() < MUTATION_RATE)
-		e.stiffness += nrand() * 20.;
+	if(rng.uniform() < MUTATION_RATE)
+		edit_edge(g, s, x, dirty).stiffness += nrand(rng) * 20.;
 		
-	if(drand48() < MUTATION_RATE)
+	if(rng.uniform() < MUTATION_RATE)
 	{
-		e.source = rand() % g.nodes.size();
-		g.edges[e.source].push_back(e);
+		Edge e = g.edges[s][x];
+		e.source = rng.below(g.nodes.size());
+		g.edges.edit(e.source).push_back(e);
 		g.remove_edge(s, x);
+		dirty.mark(e.source, DirtySet::EDGES | DirtySet::SHAPE);
+		dirty.mark(s, DirtySet::SHAPE);
 	}
 }
 
+GateNode& edit_gate(Genotype& genes, int n, int j, DirtySet& dirty)
+{
+	dirty.mark_gate(n, j);
+	return genes.nodes.edit(n).gates.edit(j);
+}
+
+GateEdge& edit_wire(Genotype& genes, int n, int j, int k, DirtySet& dirty)
+{
+	dirty.mark_wire(n, j, k);
+	return genes.nodes.edit(n).gates.edit(j).wires[k];
+}
 
-void perturb_gate(GateNode& g)
+void perturb_gate(Genotype& genes, int n, int j, DirtySet& dirty, Random& rng)
 {
-	if(drand48() < MUTATION_RATE * 0.1)
+	if(rng.uniform() < MUTATION_RATE * 0.1)
 	{
 		//Switch gate type
-		g.name = randomGateName();
-		GateFactory* f = getFactory(g.name);
-		g.params = f->generateParams();
+		GateNode& g = edit_gate(genes, n, j, dirty);
+		g.id = randomGateId(rng);
+		GateFactory* f = getFactory(g.id);
+		g.params = f->generateParams(rng);
 	}
-	else for(int i=0; i<(int)g.params.size(); i++)
+	else for(int i=0; i<(int)genes.nodes[n].gates[j].params.size(); i++)
 	{
-		if(drand48() < MUTATION_RATE)
-			g.params[i] += nrand();
+		if(rng.uniform() < MUTATION_RATE)
+			edit_gate(genes, n, j, dirty).params[i] += nrand(rng);
 	}
 }
 
-void perturb_wire(GateEdge& w)
+//Number of failed draws before the next one below p.  Skipping that many
+//gives the same odds as drawing for each in turn, with one draw per hit.
+int skip(Random& rng, double p)
 {
-	if(drand48() < MUTATION_RATE)
-		w.direction *= -1;
-	if(drand48() < MUTATION_RATE)
-		w.node = rand();
-	if(drand48() < MUTATION_RATE)
-		w.gate = rand();
-	if(drand48() < MUTATION_RATE)
-		w.gate_type = (GateType)(rand() % 3);
-	if(drand48() < MUTATION_RATE)
-		w.node_type = (NodeType)(rand() % 2);
+	double x = log(1. - rng.uniform()) / log(1. - p);
+	return x < (1 << 30) ? (int)x : (1 << 30);
 }
 
-void create_node(Genotype& genes)
+const int WIRE_FIELDS = 5;
+
+void perturb_wire(Genotype& genes, int n, int j, int k, int field, DirtySet& dirty, Random& rng)
+{
+	GateEdge& w = edit_wire(genes, n, j, k, dirty);
+	switch(field)
+	{
+		case 0: w.direction *= -1; break;
+		case 1: w.node = rng.integer(); break;
+		case 2: w.gate = rng.integer(); break;
+		case 3: w.gate_type = (GateType)rng.below(3); break;
+		case 4: w.node_type = (NodeType)rng.below(2); break;
+	}
+}
+
+void create_node(Genotype& genes, Random& rng)
 {
 	Node tmp;
-	tmp.color = NxVec3(pow(drand48()*2.,4.5)/16.,pow(drand48()*2.,4.5)/16.,pow(drand48()*2,4.5)/16.);
+	tmp.color = NxVec3(pow(rng.uniform()*2.,4.5)/16.,pow(rng.uniform()*2.,4.5)/16.,pow(rng.uniform()*2,4.5)/16.);
 	
-	tmp.shape = (BodyPartType)(rand() % 2);
+	tmp.shape = (BodyPartType)rng.below(2);
 	
 	//Body part specific information
-	tmp.size = rand_vec(5) * 5. + NxVec3(5,5,5);
-	tmp.radius = nrand(2) * 10.;
-	tmp.length = nrand(2) * 10.;
+	tmp.size = rand_vec(rng, 5) * 5. + NxVec3(5,5,5);
+	tmp.radius = nrand(rng, 2) * 10.;
+	tmp.length = nrand(rng, 2) * 10.;
 	
 	genes.nodes.push_back(tmp);
-	
-	vector<Edge> tmp2;
-	tmp2.resize(0);
-	genes.edges.push_back(tmp2);
+	genes.edges.push_back(vector<Edge>());
 }
 
-void create_edge(Genotype& genes, int x)
+void create_edge(Genotype& genes, int x, Random& rng)
 {
 	//Roll dice to select target
 	Edge tmp;
-	
-	tmp.marked = false;
 
 	//Number of times this edge may be traversed
 	tmp.source = x;
-	tmp.target = rand() % genes.nodes.size();
-	while(tmp.target == x && drand48() < .8)
-		tmp.target = rand() % genes.nodes.size();
+	tmp.target = rng.below(genes.nodes.size());
+	while(tmp.target == x && rng.uniform() < .8)
+		tmp.target = rng.below(genes.nodes.size());
 	
 	//Frame of reference for new body part
-	tmp.rot = rand_quat(1);
-	tmp.scale = nrand() + 1.;
-	tmp.reflect = (rand() & 2) ? 1 : -1;
+	tmp.rot = rand_quat(rng, 1);
+	tmp.scale = nrand(rng) + 1.;
+	tmp.reflect = rng.below(2) ? 1 : -1;
 	
-	tmp.stiffness = fabsf(nrand(10.) * 40.);
-	tmp.strength = fabsf(nrand() * 200.);
+	tmp.stiffness = fabsf(nrand(rng, 10.) * 40.);
+	tmp.strength = fabsf(nrand(rng) * 200.);
 	
 	
 	//Joint information (must be a hinge)
 	NxVec3 s_size = genes.nodes[tmp.source].size;
 	
 	tmp.s_axis = NxVec3(0,0,0);
-	tmp.s_axis[rand()%3]=(rand()%2?1.f:-1.f);
-	tmp.s_axis = rand_vec();
-	tmp.s_norm = rand_vec();
-	tmp.s_point = NxVec3(nrand(3)*s_size.x/1.5,
-				nrand(3)*s_size.y/1.5,
-				nrand(3)*s_size.z/1.5);
+	tmp.s_axis[rng.below(3)]=(rng.below(2)?1.f:-1.f);
+	tmp.s_axis = rand_vec(rng);
+	tmp.s_norm = rand_vec(rng);
+	tmp.s_point = NxVec3(nrand(rng, 3)*s_size.x/1.5,
+				nrand(rng, 3)*s_size.y/1.5,
+				nrand(rng, 3)*s_size.z/1.5);
 
 
 	NxVec3 t_size = genes.nodes[tmp.target].size;
 	tmp.t_axis = NxVec3(0,0,0);
-	tmp.t_axis[rand()%3]=(rand()%2?1.f:-1.f);
-	tmp.t_norm = rand_vec();
-	tmp.t_point = NxVec3(nrand(3)*t_size.x/1.5,
-				nrand(3)*t_size.y/1.5,
-				nrand(3)*t_size.z/1.5);
+	tmp.t_axis[rng.below(3)]=(rng.below(2)?1.f:-1.f);
+	tmp.t_norm = rand_vec(rng);
+	tmp.t_point = NxVec3(nrand(rng, 3)*t_size.x/1.5,
+				nrand(rng, 3)*t_size.y/1.5,
+				nrand(rng, 3)*t_size.z/1.5);
 				
 	
-	genes.edges[x].push_back(tmp);
+	genes.edges.edit(x).push_back(tmp);
 }
 
-void create_gate(Node& n)
+void create_gate(Node& n, Random& rng)
 {
 	GateNode tmp;
-	tmp.name = randomGateName();
-	GateFactory* f = getFactory(tmp.name);
-	tmp.params = f->generateParams();
+	tmp.id = randomGateId(rng);
+	GateFactory* f = getFactory(tmp.id);
+	tmp.params = f->generateParams(rng);
 	
 	n.gates.push_back(tmp);
 }
 
-void create_wire(GateNode& g)
+void create_wire(GateNode& g, Random& rng)
 {
 	GateEdge tmp;
 	
-	tmp.node_type = (NodeType)(rand() % 2);
-	tmp.gate_type = (GateType)(rand() % 3);
-	tmp.node = rand();
-	tmp.gate = rand();
-	tmp.direction = (rand()&2) ? 1 : -1;
+	tmp.node_type = (NodeType)rng.below(2);
+	tmp.gate_type = (GateType)rng.below(3);
+	tmp.node = rng.integer();
+	tmp.gate = rng.integer();
+	tmp.direction = rng.below(2) ? 1 : -1;
 
 	g.wires.push_back(tmp);
 }
 
 
-void remove_node(Genotype& g)
+void remove_node(Genotype& g, Random& rng)
 {
 	int N = g.nodes.size();
 	if(g.nodes.size() <= 1)
 		return;
-	g.remove_node(rand() % N);
+	g.remove_node(rng.below(N));
 }
 
-void remove_edge(Genotype& g, int i)
+void remove_edge(Genotype& g, int i, Random& rng)
 {
 	int N = g.edges[i].size();
 	if(N == 0)
 		return;
-	g.remove_edge(i, rand() % N);
+	g.remove_edge(i, rng.below(N));
 }
 
-void remove_gate(Genotype& g, int n)
+void remove_gate(Genotype& g, int n, DirtySet& dirty, Random& rng)
 {
 	int N = g.nodes[n].gates.size();
 	if(N == 0)
 		return;
-	g.remove_gate(n, rand() % N);
+	g.remove_gate(n, rng.below(N), &dirty);
+	dirty.mark(n, DirtySet::SHAPE);
 }
 
-void remove_wire(Genotype& g, int n, int gt)
+//The last wire moves into the hole, which has to be marked if the wire was
+void remove_wire(Genotype& g, int n, int gt, DirtySet& dirty, Random& rng)
 {
 	int N = g.nodes[n].gates[gt].wires.size();
 	if(N == 0)
 		return;
-	g.remove_wire(n, gt, rand() % N);
+	int k = rng.below(N);
+	g.remove_wire(n, gt, k);
+	dirty.mark_wire(n, gt, k);
 }
 
-void mutate(Genotype& genes)
+void mutate(Genotype& genes, Random& rng)
 {
+	//Removing gates or edges leaves the rest normal, so only the counts they
+	//change are marked
+	DirtySet dirty;
+	
 	//Generate new nodes
-	while(drand48() < NODE_CREATION_RATE)
+	while(rng.uniform() < NODE_CREATION_RATE)
 	{
-		create_node(genes);
+		create_node(genes, rng);
+		dirty.mark_all();
 	}
 
 	//Modify nodes
 	for(int i=0; i<(int)genes.nodes.size(); i++)
 	{
-		Node& n = genes.nodes[i];
-		
 		//Perturb nodes
-		perturb_node(n);
+		perturb_node(genes, i, dirty, rng);
 
 		//Generate random gate
-		while(drand48() < GATE_CREATION_RATE)
+		while(rng.uniform() < GATE_CREATION_RATE)
 		{
-			create_gate(n);
+			create_gate(genes.nodes.edit(i), rng);
+			dirty.mark(i, DirtySet::SHAPE);
 		}
 		
 		//Perturb gates
-		for(int j=0; j<(int)n.gates.size(); j++)
+		for(int j=0; j<(int)genes.nodes[i].gates.size(); j++)
 		{
-			GateNode& g = n.gates[j];		
-			perturb_gate(g);
+			perturb_gate(genes, i, j, dirty, rng);
 			
-			while(drand48() < WIRE_CREATION_RATE)
+			while(rng.uniform() < WIRE_CREATION_RATE)
 			{
-				create_wire(g);
+				create_wire(genes.nodes.edit(i).gates.edit(j), rng);
+				dirty.mark_wire(i, j, genes.nodes[i].gates[j].wires.size() - 1);
 			}
 
-			for(int k=0; k<(int)g.wires.size(); k++)
+			//Wires are most of a genome, so only the fields which
+			//mutate are visited
+			int sites = genes.nodes[i].gates[j].wires.size() * WIRE_FIELDS;
+			for(int x=skip(rng, MUTATION_RATE); x<sites; x+=1+skip(rng, MUTATION_RATE))
 			{
-				perturb_wire(g.wires[k]);
+				perturb_wire(genes, i, j, x / WIRE_FIELDS, x % WIRE_FIELDS, dirty, rng);
 			}
 			
-			while(drand48() < WIRE_KILL_RATE)
+			while(rng.uniform() < WIRE_KILL_RATE)
 			{
-				remove_wire(genes, i, j);
+				remove_wire(genes, i, j, dirty, rng);
 			}
 		}
 		
 		//Randomly kill off gates
-		while(drand48() < GATE_KILL_RATE)
+		while(rng.uniform() < GATE_KILL_RATE)
 		{
-			remove_gate(genes, i);
+			remove_gate(genes, i, dirty, rng);
 		}
 		
 
 		//Generate new edges
-		while(drand48() < EDGE_CREATION_RATE)
+		while(rng.uniform() < EDGE_CREATION_RATE)
 		{
-			create_edge(genes, i);
+			create_edge(genes, i, rng);
+			dirty.mark(i, DirtySet::EDGES | DirtySet::SHAPE);
 		}
 
 		//Perturb edges
 		for(int j=0; j<(int)genes.edges[i].size(); j++)
 		{
-			perturb_edge(genes, i, j);
+			perturb_edge(genes, i, j, dirty, rng);
 		}
 		
-		while(drand48() < EDGE_KILL_RATE)
+		while(rng.uniform() < EDGE_KILL_RATE)
 		{
-			remove_edge(genes, i);
+			remove_edge(genes, i, rng);
+			dirty.mark(i, DirtySet::SHAPE);
 		}
 	}
 	
-	while(drand48() < NODE_KILL_RATE && genes.nodes.size() > 1)
+	while(rng.uniform() < NODE_KILL_RATE && genes.nodes.size() > 1)
 	{
-		remove_node(genes);
+		remove_node(genes, rng);
+		dirty.mark_all();
 	}
 	
-	if(drand48() < ROOT_RELOC_RATE)
+	if(rng.uniform() < ROOT_RELOC_RATE)
 	{
-		genes.root = rand() % (int)genes.nodes.size();
+		genes.root = rng.below(genes.nodes.size());
 	}
 	
 	//Normalize genes
-	genes.normalize();
+	genes.normalize(dirty);
 }
 
-Genotype crossover(Genotype& a, Genotype& b)
+//Nodes in breadth first order from the root.  Nodes the root can't reach
+//follow in index order, unless reachable_only is set.  O(nodes + edges).
+static void bfs_order(const Genotype& g, vector<int>& order, bool reachable_only = false)
 {
-	Genotype res;
+	int N = g.nodes.size();
+	vector<char> seen(N, 0);
+	order.clear();
+	order.reserve(N);
+	
+	if(N == 0)
+		return;
+	order.push_back(g.root);
+	seen[g.root] = 1;
+	for(int x=0; x<(int)order.size(); x++)
+	{
+		const vector<Edge>& out = g.edges[order[x]];
+		for(int j=0; j<(int)out.size(); j++)
+		{
+			int t = out[j].target;
+			if(t >= 0 && t < N && !seen[t])
+			{
+				seen[t] = 1;
+				order.push_back(t);
+			}
+		}
+	}
+	
+	if(reachable_only)
+		return;
+	for(int i=0; i<N; i++)
+	{
+		if(!seen[i])
+			order.push_back(i);
+	}
+}
+
+//Appends node u of src to dst with its outgoing edges.  map gives the new
+//index of each node of src, or -1 if it isn't copied, in which case edges
+//to it are dropped.  Wires name limbs by edge number, so they travel with
+//their node as they are.
+static void copy_node(const Genotype& src, int u, const vector<int>& map, Genotype& dst)
+{
+	int v = dst.nodes.size();
+	dst.nodes.push_back(src.nodes[u]);
+	dst.edges.push_back(vector<Edge>());
+	
+	const vector<Edge>& out = src.edges[u];
+	vector<Edge>& list = dst.edges.edit(v);
+	list.reserve(out.size());
+	for(int j=0; j<(int)out.size(); j++)
+	{
+		int t = out[j].target;
+		if(t < 0 || t >= (int)map.size() || map[t] < 0)
+			continue;
+		Edge e = out[j];
+		e.source = v;
+		e.target = map[t];
+		list.push_back(e);
+	}
+}
+
+//Sims' crossover.  Both parents are laid out in breadth first order from
+//their roots, so nodes at the same depth and branch line up without any
+//search.  The child takes slots from a, switching to b between two
+//crossover points.  Where the chosen parent is too short the slot is left
+//out.  Edges keep pointing at the same slot, whoever filled it.
+//Linear in the size of the parents.
+Genotype crossover(const Genotype& a, const Genotype& b, Random& rng)
+{
+	if(a.nodes.size() == 0)
+		return b;
+	if(b.nodes.size() == 0)
+		return a;
+	
+	vector<int> order_a, order_b;
+	bfs_order(a, order_a);
+	bfs_order(b, order_b);
+	
+	int na = order_a.size(), nb = order_b.size();
+	int slots = max(na, nb);
+	int c1 = rng.below(slots + 1), c2 = rng.below(slots + 1);
+	if(c1 > c2)
+		swap(c1, c2);
 	
+	//Which parent fills each slot, and the child index it gets
+	vector<char> from_b(slots);
+	vector<int> child(slots, -1);
+	int n = 0;
+	for(int s=0; s<slots; s++)
+	{
+		from_b[s] = s >= c1 && s < c2;
+		if(s < (from_b[s] ? nb : na))
+			child[s] = n++;
+	}
 	
-	//TODO: Implement this
-	assert(false);
+	//Node index in each parent to child index, through the slots
+	vector<int> map_a(a.nodes.size(), -1), map_b(b.nodes.size(), -1);
+	for(int s=0; s<na; s++)
+		map_a[order_a[s]] = child[s];
+	for(int s=0; s<nb; s++)
+		map_b[order_b[s]] = child[s];
+	
+	Genotype res;
+	res.nodes.reserve(n);
+	res.edges.reserve(n);
+	for(int s=0; s<slots; s++)
+	{
+		if(child[s] < 0)
+			continue;
+		if(from_b[s])
+			copy_node(b, order_b[s], map_b, res);
+		else
+			copy_node(a, order_a[s], map_a, res);
+	}
 	
+	//Both roots sit in slot 0, which is never left out
+	res.root = 0;
+	res.normalize();
 	return res;
 }
 
-Genotype graft(Genotype& a, Genotype& b)
+//Sims' grafting.  A random edge of a is pointed at the root of a copy of
+//b, then whatever of a only hung off that edge is dropped.  Linear in the
+//size of the parents.  Without an edge to graft on, gives back a.
+Genotype graft(const Genotype& a, const Genotype& b, Random& rng)
 {
-	Genotype res;
+	int num_edges = 0;
+	for(int i=0; i<(int)a.edges.size(); i++)
+		num_edges += a.edges[i].size();
+	if(num_edges == 0 || b.nodes.size() == 0)
+		return a;
 	
-	//TODO: Implement this
-	assert(false);
+	//a followed by b
+	int na = a.nodes.size(), nb = b.nodes.size();
+	Genotype joined = a;
+	vector<int> map_b(nb);
+	for(int i=0; i<nb; i++)
+		map_b[i] = na + i;
+	for(int i=0; i<nb; i++)
+		copy_node(b, i, map_b, joined);
 	
+	int k = rng.below(num_edges), s = 0;
+	while(k >= (int)a.edges[s].size())
+		k -= a.edges[s++].size();
+	joined.edges.edit(s)[k].target = na + b.root;
+	
+	//Keep what the root still reaches, in breadth first order
+	vector<int> order;
+	bfs_order(joined, order, true);
+	vector<int> map(joined.nodes.size(), -1);
+	for(int x=0; x<(int)order.size(); x++)
+		map[order[x]] = x;
+	
+	Genotype res;
+	res.nodes.reserve(order.size());
+	res.edges.reserve(order.size());
+	for(int x=0; x<(int)order.size(); x++)
+		copy_node(joined, order[x], map, res);
+	res.root = 0;
+	res.normalize();
 	return res;
 }
 
 //Generates a random creature
-Genotype randomCreature(int N, int E, int G, int W)
+Genotype randomCreature(Random& rng, int N, int E, int G, int W)
 {
 	Genotype res;
 	
-	for(int i=rand()%(N-1); i<N; i++)
+	for(int i=rng.below(N-1); i<N; i++)
 	{
-		create_node(res);
+		create_node(res, rng);
 		
-		for(int j=rand()%G; j<G; j++)
+		for(int j=rng.below(G); j<G; j++)
 		{
-			Node& n = res.nodes[res.nodes.size()-1];
-			create_gate(n);
-			GateNode& g = n.gates[n.gates.size()-1];
-			for(int k=rand()%W; k<W; k++)
-				create_wire(g);
+			Node& n = res.nodes.edit_back();
+			create_gate(n, rng);
+			GateNode& g = n.gates.edit_back();
+			for(int k=rng.below(W); k<W; k++)
+				create_wire(g, rng);
 		}
 		
-		for(int j=rand()%E; j<E-1; j++)
-			create_edge(res, res.nodes.size()-1);	
+		for(int j=rng.below(E); j<E-1; j++)
+			create_edge(res, res.nodes.size()-1, rng);	
 	}
 	
-	res.root = rand() % res.nodes.size();
+	res.root = rng.below(res.nodes.size());
 	
 	res.normalize();
 	
@@ -1,15 +1,21 @@
 #ifndef MUTATIONS_H
 #define MUTATIONS_H
 
+#include "common/random.h"
+
 #include "project/genotype.h"
 
 namespace Game
 {
 
-Genotype randomCreature(int N = 10, int E=4, int G=10, int W=50);
-void mutate(Genotype& genes);
-Genotype crossover(Genotype& a, Genotype& b);
-Genotype graft(Genotype& a, Genotype& b);
+//Every random choice comes from rng, so the same rng state breeds the same child
+Genotype randomCreature(Common::Random& rng, int N = 10, int E=4, int G=10, int W=50);
+void mutate(Genotype& genes, Common::Random& rng);
+
+//Recombination of two parents, see mutation.cpp.  Both take time linear in
+//the size of the parents, and the child comes out normalized.
+Genotype crossover(const Genotype& a, const Genotype& b, Common::Random& rng);
+Genotype graft(const Genotype& a, const Genotype& b, Common::Random& rng);
 
 
 };
@@ -4,14 +4,22 @@
 #include <string>
 #include <iostream>
 #include <utility>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <map>
 
 #include "common/sys_includes.h"
 #include "common/physics.h"
+#include "common/timer.h"
 
 #include "project/population.h"
 #include "project/creature.h"
 #include "project/genotype.h"
 #include "project/mutation.h"
+#include "project/evaluator.h"
+#include "project/genotype_io.h"
+#include "project/fitness_cache.h"
 
 
 using namespace std;
@@ -20,112 +28,188 @@ using namespace Common;
 namespace Game
 {
 
-//Create a creature in the middle of space
-void FitnessTest::start_test(Genotype& genes)
+//Population constructor
+Population::Population(
+		int num_creatures_,
+		int num_high_scores_,
+		FitnessTest* tester_,
+		const Random& rng_)
+	: species(num_creatures_),
+	  best_species(num_high_scores_),
+	  tester(tester_),
+	  generation(0),
+	  verbose(true),
+	  best_file("data/best.dna"),
+	  stats_log(NULL),
+	  prescreen(false),
+	  screen_keep(1.),
+	  selector(new RouletteSelector()),
+	  crossover_rate(0.),
+	  graft_rate(0.),
+	  prune_genes(false),
+	  parsimony(0.),
+	  rng(rng_),
+	  cache_fitness(false),
+	  telemetry(NULL),
+	  current_test(0),
+	  num_pruned(0)
 {
-	//genes.save(cout);
-	
-	cout << "Generating creature..." << endl;
-	NxMat34 start_pos;
-	start_pos.id();
-	
-	creature = genes.createCreature(start_pos);
 	
-	if(creature == NULL)
+	//Generate a random intial population
+	for(int i=0; i<(int)species.size(); i++)
 	{
-		cout << "Failed to construct creature!" << endl;	
+		species[i] = make_pair(0., randomCreature(rng));
 	}
-	
-	base_position = NxVec3(0.,0.,0.);
-	fitness = 1e-4;
-	current_time = 0.;
-	max_height = -1e10;
-}
 
-//Update the creature's position
-bool FitnessTest::update()
-{
-	if(creature == NULL)
-		return false;
+/*
+	//Recover best creature
+	ifstream best("data/best.dna");
+	species[0] = make_pair(0., Genotype::load(best));
+	best.close();
+*/
 
-	creature->update();
-	NxMat34 pose = creature->get_pose();
-	NxVec3 pos = pose.t;
-	
-	if(current_time <= rest_time)
+	for(int i=0; i<(int)best_species.size(); i++)
 	{
-		base_position = pos;
+		best_species[i] = species[0];
 	}
 	
-	max_height = max(max_height, (double)pos.y);
+	screen_generation();
+}
+
+Population::~Population()
+{
+	delete selector;
+}
+
+void Population::set_selector(Selector* s)
+{
+	delete selector;
+	selector = s;
+}
+
+void Population::screen_generation()
+{
+	jobs.clear();
+	copies.clear();
+	keys.clear();
+	stopped.assign(species.size(), 0);
+	cached.assign(species.size(), 0);
+	num_cached = 0;
+	screen_time = 0.;
 	
-	//Update fitness function
-	fitness = (pos - base_position) .magnitude() + 1e-3;
+	vector<int> slots(species.size());
+	for(int i=0; i<(int)slots.size(); i++)
+		slots[i] = i;
+	screen(slots);
+}
+
+//Weed out hopeless genotypes before spending a trial on them.  Genotypes
+//which were scored before, or which repeat an earlier species of this
+//generation, don't need a trial either.
+void Population::screen(const vector<int>& slots)
+{
+	double t0 = wall_time();
 	
-	for(int i=0; i<(int)creature->body.size(); i++)
+	vector<int> pending;
+	if(cache_fitness)
 	{
-		BodyPart *p = creature->body[i];
-		for(int j=0; j<(int)p->joints.size(); j++)
+		keys.resize(species.size());
+		map<string, int> seen;
+		for(int x=0; x<(int)slots.size(); x++)
 		{
-			if(p->joints[j]->getState() == NX_JS_BROKEN)
+			int i = slots[x];
+			keys[i] = GenotypeKey(species[i].second);
+			cached[i] = 1;
+			if(fitness_cache.find(keys[i], species[i].first))
+				continue;
+			
+			map<string, int>::iterator it = seen.find(keys[i].blob);
+			if(it != seen.end())
 			{
-				fitness = 0.0001;
-				delete creature;
-				creature = NULL;
-				return false;
+				copies.push_back(make_pair(i, it->second));
+				continue;
 			}
+			seen[keys[i].blob] = i;
+			cached[i] = 0;
+			pending.push_back(i);
 		}
 	}
+	else
+	{
+		pending = slots;
+	}
 	
-	
-	current_time += 1.;
-
-	if(current_time > round_time || creature->body.size() <= 1)
+	num_cached += slots.size() - pending.size();
+	if(!prescreen)
 	{
-		delete creature;
-		creature = NULL;
-		return false;
+		jobs.insert(jobs.end(), pending.begin(), pending.end());
+		sort(jobs.begin(), jobs.end());
+		screen_time += wall_time() - t0;
+		return;
 	}
 	
-	return true;
+	vector<ScreenResult> results;
+	if(screen_opts.batch)
+	{
+		vector<const Genotype*> genes;
+		for(int i=0; i<(int)pending.size(); i++)
+			genes.push_back(&species[pending[i]].second);
+		Game::prescreen(genes, results, screen_opts);
+	}
+	else
+	{
+		for(int i=0; i<(int)pending.size(); i++)
+			results.push_back(Game::prescreen(species[pending[i]].second, screen_opts));
+	}
 	
-}
-
-void FitnessTest::draw()
-{
-	if(creature != NULL)
-		creature->draw();
-}
-
-
-//Population constructor
-Population::Population(
-		int num_creatures_,
-		int num_high_scores_,
-		FitnessTest* tester_)
-	: species(num_creatures_),
-	  best_species(num_high_scores_),
-	  tester(tester_),
-	  current_test(0)
-{
+	vector< pair<float,int> > ranked;
+	for(int i=0; i<(int)pending.size(); i++)
+	{
+		const ScreenResult& r = results[i];
+		if(r.viable)
+		{
+			ranked.push_back(make_pair(-r.score, pending[i]));
+		}
+		else
+		{
+			//Same score as a creature which fails to build
+			species[pending[i]].first = 1e-4;
+			if(verbose)
+				cout << "Rejected " << pending[i] << ": " << r.reason << endl;
+		}
+	}
 	
-	//Generate a random intial population
-	for(int i=0; i<(int)species.size(); i++)
+	//Only the most promising fraction gets a trial
+	sort(ranked.begin(), ranked.end());
+	int keep = (int)ceil(screen_keep * ranked.size());
+	for(int i=0; i<(int)ranked.size(); i++)
 	{
-		species[i] = make_pair(0., randomCreature());
+		if(i < keep)
+			jobs.push_back(ranked[i].second);
+		else
+			species[ranked[i].second].first = 1e-4;
 	}
+	
+	//Keep the original test order
+	sort(jobs.begin(), jobs.end());
+	screen_time += wall_time() - t0;
+}
 
-/*
-	//Recover best creature
-	ifstream best("data/best.dna");
-	species[0] = make_pair(0., Genotype::load(best));
-	best.close();
-*/
-
-	for(int i=0; i<(int)best_species.size(); i++)
+//Once every trial of the generation is in, remembers the scores and hands
+//them on to the duplicates which sat out.  A trial a stop rule cut short
+//didn't run its course, so that genotype gets a full trial next time.
+void Population::finish_generation()
+{
+	if(cache_fitness)
 	{
-		best_species[i] = species[0];
+		for(int i=0; i<(int)jobs.size(); i++)
+		{
+			if(!stopped[jobs[i]])
+				fitness_cache.insert(keys[jobs[i]], species[jobs[i]].first);
+		}
 	}
+	for(int i=0; i<(int)copies.size(); i++)
+		species[copies[i].first].first = species[copies[i].second].first;
 }
 	
 //Updates the population
@@ -135,40 +219,53 @@ void Population::update()
 	{
 		if(current_test > 0)
 		{
-			species[current_test-1].first = tester->fitness;
-			cout << "Fitness = " << tester->fitness << endl;
+			species[jobs[current_test-1]].first = tester->fitness;
+			stopped[jobs[current_test-1]] = tester->stopped;
 			
 			//Print stats
-			NxSceneStats stats;
-			scene->getStats(stats);
-			cout << "Num actors = " << stats.numActors << endl
-				 << "Num joints = " << stats.numJoints << endl
-				 << "Num contacts = " << stats.numContacts << endl;
+			if(verbose)
+			{
+				NxSceneStats stats;
+				tester->scene->getStats(stats);
+				cout << "Fitness = " << tester->fitness << endl
+					 << "Num actors = " << stats.numActors << endl
+					 << "Num joints = " << stats.numJoints << endl
+					 << "Num contacts = " << stats.numContacts << endl;
+			}
 		}
 	
-		if(current_test >= (int)species.size())
+		while(current_test >= (int)jobs.size())
 		{
+			finish_generation();
 			next_round();
 			current_test = 0;
 		}
 		
 		//Start new test
 		current_test++;
-		cout << "Testing : " << current_test << endl;
-		tester->start_test(species[current_test-1].second);
+		if(verbose)
+			cout << "Testing : " << jobs[current_test-1]+1 << endl;
+		tester->threshold = best_species[0].first;
+		tester->start_test(species[jobs[current_test-1]].second);
 	}
 }
 
 void Population::next_round()
 {
 	//Normalize scores, store high scoring creature
-	cout << "Total scores:" << endl;
-	float s = 0.;
+	if(verbose)
+		cout << "Total scores:" << endl;
+	float s = 0.,
+		  lo = species[0].first,
+		  hi = species[0].first;
 	for(int i=0; i<(int)species.size(); i++)
 	{
-		cout << species[i].first << endl;
+		if(verbose)
+			cout << species[i].first << endl;
 	
 		s += species[i].first;
+		lo = min(lo, species[i].first);
+		hi = max(hi, species[i].first);
 		if(species[i].first > best_species[0].first)
 		{
 			best_species[0] = species[i];
@@ -176,34 +273,205 @@ void Population::next_round()
 		}
 	}
 	
-	cout << "Top score:" << endl;
-	cout << best_species[best_species.size()-1].first << endl;
+	if(verbose)
+	{
+		cout << "Top score:" << endl;
+		cout << best_species[best_species.size()-1].first << endl;
+	}
 	
-	ofstream best("data/best.dna");
+	//Log generation: number, min, mean, max, best ever
+	if(stats_log != NULL)
+	{
+		(*stats_log)	<< generation << ' '
+						<< lo << ' '
+						<< s / species.size() << ' '
+						<< hi << ' '
+						<< best_species[best_species.size()-1].first << endl;
+	}
+	
+	ofstream best(best_file.c_str());
 	best_species[best_species.size()-1].second.save(best);
 	
-	//Generate new population using stupid rule
-	vector< pair<float,Genotype> >  next(species.size());
+	vector< pair<float,Genotype> > next;
+	breed(next);
+	
+	//Set new species
+	species = next;
+	generation++;
 	
+	screen_generation();
+}
+
+void Population::breed(vector< pair<float,Genotype> >& next)
+{
+	//Pick parents and generate the new population
+	vector<float> scores(species.size());
+	for(int i=0; i<(int)species.size(); i++)
+	{
+		scores[i] = species[i].first;
+		if(parsimony > 0.)
+			scores[i] /= 1. + parsimony * species[i].second.circuit_size();
+	}
+	selector->prepare(scores);
+	
+	next.resize(species.size());
+	num_pruned = 0;
+	
+	//Child i only ever sees stream i of this round's key, so its genes don't
+	//depend on the order the children are bred in, or on who breeds them
+	unsigned long key = rng.next();
 	for(int i=0; i<(int)species.size(); i++)
 	{
-		float r = drand48() * s;
-		for(int j=0; j<(int)species.size(); j++)
+		Random child_rng(key, i);
+		int j = selector->select(child_rng);
+		if(verbose)
+			cout << "Fitness: " << species[j].first << endl;
+	
+		//Without recombination no extra number is drawn, so runs
+		//with both rates at zero breed the same children as before
+		float r = crossover_rate + graft_rate > 0. ? child_rng.uniform() : 1.;
+		if(r < crossover_rate + graft_rate)
 		{
-			r -= species[j].first;
-			if(r <= 0.)
-			{
-				cout << "Fitness: " << species[j].first << endl;
-			
-				next[i] = make_pair(0., species[j].second);
-				mutate(next[i].second);
-				break;
-			}
+			const Genotype& other = species[selector->select(child_rng)].second;
+			if(r < crossover_rate)
+				next[i] = make_pair(0., crossover(species[j].second, other, child_rng));
+			else
+				next[i] = make_pair(0., graft(species[j].second, other, child_rng));
 		}
+		else
+		{
+			next[i] = make_pair(0., species[j].second);
+		}
+		mutate(next[i].second, child_rng);
+		if(prune_genes)
+			num_pruned += next[i].second.prune();
 	}
+}
+
+//Nearest rank percentiles of the scores
+static void percentiles(const vector< pair<float,Genotype> >& species, float out[NUM_PERCENTILES])
+{
+	vector<float> scores(species.size());
+	for(int i=0; i<(int)species.size(); i++)
+		scores[i] = species[i].first;
+	sort(scores.begin(), scores.end());
 	
-	//Set new species
-	species = next;
+	for(int i=0; i<NUM_PERCENTILES; i++)
+	{
+		int r = (int)ceil(PERCENTILES[i] / 100. * scores.size()) - 1;
+		out[i] = scores[max(r, 0)];
+	}
+}
+
+//Batch mode: run every test of the generation at once
+void Population::run_generation(ParallelEvaluator& evaluator)
+{
+	double t0 = wall_time();
+	double build0 = evaluator.build_time();
+	PoolStats actors0 = evaluator.pool_stats(), skeletons0 = skeleton_stats();
+	
+	//Trials which can't make the high scores may be cut short
+	evaluator.set_threshold(best_species[0].first);
+	evaluator.set_generation(generation);
+	evaluator.set_telemetry(telemetry);
+	evaluator.evaluate(species, jobs, &stopped);
+	finish_generation();
+	
+	GenerationRecord record;
+	if(telemetry != NULL)
+	{
+		record.generation		= generation;
+		record.species			= species.size();
+		record.trials			= jobs.size();
+		record.cached			= num_cached;
+		record.rejected			= species.size() - num_cached - jobs.size();
+		record.screen_time		= screen_time;
+		record.evaluate_time	= wall_time() - t0;
+		percentiles(species, record.fitness);
+		
+		PoolStats actors = evaluator.pool_stats(), skeletons = skeleton_stats();
+		record.build_time		= evaluator.build_time() - build0;
+		record.actors_created	= actors.created - actors0.created;
+		record.actors_reused	= actors.reused - actors0.reused;
+		record.skeletons_cooked	= skeletons.created - skeletons0.created;
+		record.skeletons_reused	= skeletons.reused - skeletons0.reused;
+		record.build_saved		= actors.saved(actors0) + skeletons.saved(skeletons0);
+		record.circuits			= evaluator.take_circuit_profile();
+		
+		long size = 0;
+		for(int i=0; i<(int)species.size(); i++)
+			size += species[i].second.circuit_size();
+		record.circuit_size		= (float)size / species.size();
+	}
+	
+	double t1 = wall_time();
+	next_round();
+	current_test = 0;
+	
+	//next_round() already screened the coming generation
+	if(telemetry != NULL)
+	{
+		record.breed_time	= wall_time() - t1 - screen_time;
+		record.pruned		= num_pruned;
+		record.best			= best_species[best_species.size()-1].first;
+		telemetry->generation(record);
+	}
+}
+
+void Population::emigrants(int count, vector< pair<float,Genotype> >& out) const
+{
+	count = min(count, (int)best_species.size());
+	out.resize(count);
+	for(int i=0; i<count; i++)
+		out[i] = best_species[best_species.size()-1-i];
+}
+
+//Children are in random order already, so the last few are as good as any.
+//Migrants bring their score along, which goes into the cache, and only the
+//replaced slots and their duplicates are screened again.
+void Population::immigrate(const vector< pair<float,Genotype> >& migrants)
+{
+	int n = min(migrants.size(), species.size());
+	vector<char> replaced(species.size(), 0);
+	for(int i=0; i<n; i++)
+	{
+		int r = species.size()-1-i;
+		species[r] = make_pair(0., migrants[i].second);
+		if(cache_fitness)
+			fitness_cache.insert(GenotypeKey(species[r].second), migrants[i].first);
+		replaced[r] = 1;
+	}
+	
+	//Duplicates of a replaced species lost their original
+	vector< pair<int,int> > kept;
+	for(int i=0; i<(int)copies.size(); i++)
+	{
+		if(replaced[copies[i].second])
+			replaced[copies[i].first] = 1;
+		else if(!replaced[copies[i].first])
+			kept.push_back(copies[i]);
+	}
+	copies.swap(kept);
+	
+	vector<int> slots, left;
+	for(int i=0; i<(int)species.size(); i++)
+	{
+		if(!replaced[i])
+			continue;
+		slots.push_back(i);
+		num_cached -= cached[i];
+		cached[i] = 0;
+		stopped[i] = 0;
+	}
+	for(int i=0; i<(int)jobs.size(); i++)
+	{
+		if(!replaced[jobs[i]])
+			left.push_back(jobs[i]);
+	}
+	jobs.swap(left);
+	
+	current_test = 0;
+	screen(slots);
 }
 
 void Population::draw()
@@ -211,14 +479,153 @@ void Population::draw()
 	tester->draw();
 }
 
-void Population::save(ostream& os)
+//Population file format
+//
+//	PopulationHeader, then num_species + num_best entries of
+//
+//		float		fitness
+//		NxU32		size of the genotype blob
+//		char		binary genotype [size]
+//
+//	Genotype blobs are always a multiple of 4 bytes, so every entry stays
+//	aligned when the file is mapped into memory.
+
+const NxU32 POPULATION_MAGIC	= 0x42504f50;	//"POPB"
+const NxU32 POPULATION_VERSION	= 1;
+
+struct PopulationHeader
+{
+	NxU32	magic;
+	NxU32	version;
+	NxU32	byte_order;
+	NxU32	num_species, num_best;
+	NxU32	generation;
+	NxU32	rng[Random::STATE_SIZE];
+};
+
+void save_species_entry(const pair<float,Genotype>& entry, ostream& os)
+{
+	NxU32 size = binary_size(entry.second);
+	os.write((const char*)&entry.first, sizeof(float));
+	os.write((const char*)&size, sizeof(size));
+	save_binary(entry.second, os);
+}
+
+pair<float,Genotype> load_species_entry(const char*& ptr, const char* end)
+{
+	if((size_t)(end - ptr) < sizeof(float) + sizeof(NxU32))
+		throw "Truncated population";
+
+	float fitness;
+	NxU32 size;
+	memcpy(&fitness, ptr, sizeof(float));
+	memcpy(&size, ptr + sizeof(float), sizeof(NxU32));
+	ptr += sizeof(float) + sizeof(NxU32);
+	
+	if(size > (size_t)(end - ptr))
+		throw "Truncated population";
+	
+	pair<float,Genotype> res(fitness, load_binary(ptr, size));
+	ptr += size;
+	return res;
+}
+
+void PopulationState::save(ostream& os) const
 {
+	PopulationHeader h;
+	h.magic			= POPULATION_MAGIC;
+	h.version		= POPULATION_VERSION;
+	h.byte_order	= BYTE_ORDER_MARK;
+	h.num_species	= species.size();
+	h.num_best		= best_species.size();
+	h.generation	= generation;
+	for(int i=0; i<Random::STATE_SIZE; i++)
+		h.rng[i]	= rng[i];
+	os.write((const char*)&h, sizeof(h));
+	
+	for(int i=0; i<(int)species.size(); i++)
+		save_species_entry(species[i], os);
+	for(int i=0; i<(int)best_species.size(); i++)
+		save_species_entry(best_species[i], os);
+}
+
+//Parses a population straight out of memory (e.g. a MappedFile)
+void PopulationState::load(const char* data, size_t size)
+{
+	if(size < sizeof(PopulationHeader))
+		throw "Truncated population";
+	
+	PopulationHeader h;
+	memcpy(&h, data, sizeof(h));
+	if(h.magic != POPULATION_MAGIC)
+		throw "Not a population file";
+	if(h.byte_order != BYTE_ORDER_MARK)
+		throw "Population file has the wrong byte order";
+	if(h.version != POPULATION_VERSION)
+		throw "Unsupported population version";
+	if(h.num_species == 0 || h.num_best == 0)
+		throw "Empty population";
+	
+	const char* ptr = data + sizeof(h);
+	const char* end = data + size;
+	
+	vector< pair<float,Genotype> > s, b;
+	s.reserve(h.num_species);
+	b.reserve(h.num_best);
+	for(int i=0; i<(int)h.num_species; i++)
+		s.push_back(load_species_entry(ptr, end));
+	for(int i=0; i<(int)h.num_best; i++)
+		b.push_back(load_species_entry(ptr, end));
+	
+	species.swap(s);
+	best_species.swap(b);
+	generation	= h.generation;
+	for(int i=0; i<Random::STATE_SIZE; i++)
+		rng[i] = h.rng[i];
+}
+
+void Population::snapshot(PopulationState& state) const
+{
+	state.generation	= generation;
+	rng.get_state(state.rng);
+	state.species		= species;
+	state.best_species	= best_species;
+}
+
+void Population::restore(const PopulationState& state)
+{
+	species			= state.species;
+	best_species	= state.best_species;
+	generation		= state.generation;
+	rng.set_state(state.rng);
+	
+	current_test = 0;
+	screen_generation();
+}
+
+void Population::save(ostream& os) const
+{
+	PopulationState state;
+	snapshot(state);
+	state.save(os);
 }
 
 void Population::load(istream& is)
 {
+	vector<char> buf(
+		(istreambuf_iterator<char>(is)),
+		istreambuf_iterator<char>());
+	if(buf.size() == 0)
+		throw "Empty population file";
+	load(&buf[0], buf.size());
 }
 
+void Population::load(const char* data, size_t size)
+{
+	PopulationState state;
+	state.load(data, size);
+	restore(state);
+}
 
 
 };
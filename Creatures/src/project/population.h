@@ -3,37 +3,41 @@
 
 #include <iostream>
 #include <string>
+#include <cstddef>
+
+#include "common/random.h"
 
 #include "project/creature.h"
 #include "project/genotype.h"
+#include "project/prescreen.h"
+#include "project/selection.h"
+#include "project/fitness_cache.h"
+#include "project/fitness.h"
+#include "project/telemetry.h"
 
 namespace Game
 {
 
-//Interface for a fitness test
-struct FitnessTest
+//Everything needed to resume a run where it left off
+struct PopulationState
 {
-	Creature* creature;
-	NxVec3 base_position;
-	
-	double current_time, round_time, rest_time, fitness;
-	
-	double max_height;
+	int								generation;
+	unsigned int					rng[Common::Random::STATE_SIZE];
+	vector< pair<float,Genotype> >	species;
+	vector< pair<float,Genotype> >	best_species;
 	
+	PopulationState() : generation(0) {}
 	
-	FitnessTest() {}
-	FitnessTest(
-		float round_time_,
-		float rest_time_) : 
-			creature(NULL),
-			round_time(round_time_),
-			rest_time(rest_time_) {}
-
-	virtual void start_test(Genotype& genes);
-	virtual bool update();
-	virtual void draw();
+	//Binary population file, see population.cpp
+	void save(ostream& os) const;
+	void load(const char* data, size_t size);
 };
 
+//One fitness and genotype entry of a population file.  load_species_entry
+//advances ptr past the entry and throws if it runs past end.
+void save_species_entry(const pair<float,Genotype>& entry, ostream& os);
+pair<float,Genotype> load_species_entry(const char*& ptr, const char* end);
+
 //A population of creatures
 struct Population
 {
@@ -42,25 +46,141 @@ struct Population
 	
 	FitnessTest*	tester;
 	
+	//Number of generations bred so far
+	int				generation;
+	
+	//Output options
+	bool			verbose;		//Print every score on cout
+	string			best_file;		//Best genotype is written here each round
+	ostream*		stats_log;		//If set, one line of stats per generation
+	
+	//Pre-screening options, off by default
+	bool			prescreen;		//Skip trials of genotypes which can't score
+	float			screen_keep;	//Fraction of viable genotypes given a full trial
+	ScreenOptions	screen_opts;
+	
+	//Parent selection policy, owned by the population.  Roulette by default.
+	Selector*		selector;
+	
+	//Fractions of children bred by crossover or grafting of two parents
+	//instead of copying one.  Every child is mutated afterwards.
+	float			crossover_rate;
+	float			graft_rate;
+	
+	//Bloat control.  prune_genes strips every child of the gates and wires
+	//which can't move it, see Genotype::prune().  Parents are picked on
+	//score / (1 + parsimony * size), size counting their gates and wires.
+	bool			prune_genes;
+	float			parsimony;
+	
+	//Source of all randomness in breeding.  Each child of a round is bred
+	//from its own stream keyed off this, see next_round().
+	Common::Random	rng;
+	
+	//Genotypes which were scored before skip their trial.  Off by default,
+	//only turn it on if the fitness test is reproducible.
+	bool			cache_fitness;
+	FitnessCache	fitness_cache;
+	
+	//If set, run_generation() logs every trial and a summary of each
+	//generation here.  Not owned.
+	Telemetry*		telemetry;
+	
 	//Constructors
-	Population() {}
+	Population() :
+		tester(NULL),
+		prescreen(false),
+		selector(NULL),
+		crossover_rate(0.),
+		graft_rate(0.),
+		prune_genes(false),
+		parsimony(0.),
+		cache_fitness(false),
+		telemetry(NULL),
+		num_pruned(0) {}
 	Population(
 		int num_creatures,
 		int num_high_scores,
-		FitnessTest* test);
+		FitnessTest* test,
+		const Common::Random& rng = Common::Random());
+	~Population();
+	
+	//Replaces the selection policy
+	void set_selector(Selector* s);
 	
 	//Updates the population
 	void update();
 	void draw();
+	
+	//Scores a whole generation with the evaluator, then breeds the next one
+	void run_generation(struct ParallelEvaluator& evaluator);
+	
+	//Pre-screens the current species and rebuilds the list of pending trials.
+	//Called automatically for each new generation, call it again after
+	//changing the screening options.
+	void screen_generation();
+	
+	//Picks parents among the species and breeds one child for each into
+	//next, all scored zero.  Leaves the species alone, next_round() moves on
+	//to the children afterwards.
+	void breed(vector< pair<float,Genotype> >& next);
+	
+	//Island model migration, only valid between generations.  emigrants()
+	//copies out the best count high scores, best first.  immigrate() puts
+	//migrants in place of the last species of the coming generation.  They
+	//keep the score they came with if the fitness cache is on, otherwise
+	//they get a trial like any other child.
+	void emigrants(int count, vector< pair<float,Genotype> >& out) const;
+	void immigrate(const vector< pair<float,Genotype> >& migrants);
+
+	//Copies out / restores the generation, random state and all genotypes.
+	//Only valid between generations.
+	void snapshot(PopulationState& state) const;
+	void restore(const PopulationState& state);
 
-	void save(ostream& os);
-	static void load(istream& is);
+	//Binary snapshot of species and high scores, see genotype_io.h
+	void save(ostream& os) const;
+	void load(istream& is);
+	void load(const char* data, size_t size);
 	
 private:
 	int 	current_test;
+	
+	//Species which still need a full trial this generation
+	vector<int>	jobs;
+	
+	//Cache keys of the species, and species which repeat an earlier one
+	//and take its score, as (copy, original).  Only kept while caching.
+	vector<GenotypeKey>			keys;
+	vector< pair<int,int> >		copies;
+	
+	//Species whose trial a stop rule cut short, their score isn't cached
+	vector<char>				stopped;
+	
+	//Species which took their score from the cache or a duplicate
+	vector<char>				cached;
+	
+	//Statistics of the last screen_generation() and immigrate(), for the
+	//telemetry
+	double	screen_time;
+	int		num_cached;
+	
+	//Genes prune() took out of the children of the last round
+	int		num_pruned;
+
+	//Screens the listed species and adds their trials to jobs.  They must
+	//not be in jobs or copies already.
+	void screen(const vector<int>& slots);
+	
+	//Records the trial results, called once all jobs are done
+	void finish_generation();
 
 	///Generates a new creature
 	void next_round();
+	
+	//Not copyable, owns the selector
+	Population(const Population&);
+	Population& operator=(const Population&);
 };
 
 };
@@ -0,0 +1,327 @@
+#include <vector>
+#include <utility>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#include "common/sys_includes.h"
+
+#include "project/circuit.h"
+#include "project/batch_circuit.h"
+#include "project/creature.h"
+#include "project/genotype.h"
+#include "project/prescreen.h"
+
+using namespace std;
+
+namespace Game
+{
+
+//Stands in for a JointSensor, feeds a slowly turning joint orientation
+struct DrySensor : Gate
+{
+	float phase, time;
+	
+	DrySensor(float phase_) : phase(phase_), time(0) {}
+	virtual ~DrySensor() {}
+	virtual void update()
+	{
+		float t = 0.05 * time + phase;
+		time += 1.;
+		
+		write(0, 0.1 * sin(t));
+		write(1, 0.1 * cos(t));
+		write(2, 0.);
+		write(3, 0.99);
+	}
+};
+
+//Stands in for a JointEffector, records the range of its drive signal
+struct DryEffector : Gate
+{
+	float lo[4], hi[4];
+	bool finite;
+	
+	DryEffector() : finite(true)
+	{
+		for(int i=0; i<4; i++)
+		{
+			lo[i] = FLT_MAX;
+			hi[i] = -FLT_MAX;
+		}
+	}
+	virtual ~DryEffector() {}
+	virtual void update()
+	{
+		for(int i=0; i<4; i++)
+		{
+			float x = read(i);
+			if(!(x == x) || fabsf(x) > FLT_MAX)
+			{
+				finite = false;
+				continue;
+			}
+			lo[i] = min(lo[i], x);
+			hi[i] = max(hi[i], x);
+		}
+	}
+	
+	float swing() const
+	{
+		float s = 0.;
+		for(int i=0; i<4; i++)
+		{
+			if(hi[i] >= lo[i])
+				s += hi[i] - lo[i];
+		}
+		return s;
+	}
+};
+
+//Bounding sphere of a part, used for the overlap estimate
+struct PartBounds
+{
+	NxVec3	center;
+	float	radius;
+	int		parent;
+};
+
+//Same traversal as genCreatureRec, minus the physics
+static BodyPart* screenRec(
+	const Genotype&			genes,
+	EdgeMarks&				marks,
+	Creature*				creature,
+	int						n,
+	NxMat34					pose,
+	float					scale,
+	int						parent,
+	vector<PartBounds>&		bounds,
+	vector<DryEffector*>&	effectors,
+	const ScreenOptions&	opts)
+{
+	if((int)creature->body.size() >= opts.max_parts)
+		return NULL;
+
+	const Node& node = genes.nodes[n];
+	BodyPart* res = new (creature->arena) BodyPart(creature, node.size * scale);
+	creature->body.push_back(res);
+	
+	int id = bounds.size();
+	PartBounds b;
+	b.center = pose.t;
+	b.radius = (node.size * scale).magnitude();
+	b.parent = parent;
+	bounds.push_back(b);
+	
+	createGates(node, res);
+	
+	for(int i=0; i<(int)genes.edges[n].size(); i++)
+	{
+		const Edge& edge = genes.edges[n][i];
+		if(marks.marked(n, i))
+			continue;
+		marks.mark(n, i, true);
+		
+		NxMat33 R = edge.rot;
+		NxVec3 s_point = edge.s_point * (scale + 0.01), 
+			   t_point = edge.t_point * (scale * edge.scale + 0.01);
+		
+		NxMat34 npose;
+		npose.M = pose.M * R;
+		npose.t = pose * s_point - npose.M * t_point;
+		
+		BodyPart* tmp = screenRec(
+			genes,
+			marks,
+			creature,
+			edge.target,
+			npose,
+			scale * edge.scale,
+			id,
+			bounds,
+			effectors,
+			opts);
+		
+		marks.mark(n, i, false);
+		if(tmp == NULL)
+			return NULL;
+		
+		//Same layout as attachPart
+		Common::Arena& arena = creature->arena;
+		DryEffector* e = arena.own(new (arena) DryEffector());
+		effectors.push_back(e);
+		res->limbs.push_back(tmp);
+		res->effectors.push_back(e);
+		res->sensors.push_back(arena.own(new (arena) DrySensor(effectors.size())));
+	}
+	
+	rigWires(node, res);
+	return res;
+}
+
+//A dry body waiting for, or done with, its circuit run
+struct DryRun
+{
+	Creature				creature;
+	vector<PartBounds>		bounds;
+	vector<DryEffector*>	effectors;
+	ScreenResult			res;
+	
+	DryRun() : creature(NULL) {}
+};
+
+//Builds the dry body and checks its shape.  Returns true if the circuit
+//should be compiled and dry run, false if res already holds the verdict.
+static bool build_dry_run(const Genotype& genes, const ScreenOptions& opts, DryRun& run)
+{
+	ScreenResult& res = run.res;
+	res.viable		= false;
+	res.reason		= NULL;
+	res.num_parts	= 0;
+	res.num_joints	= 0;
+	res.activity	= 0.;
+	res.overlap		= 0.;
+	res.score		= 0.;
+	
+	if(genes.nodes.size() == 0)
+	{
+		res.reason = "empty genotype";
+		return false;
+	}
+
+	//Build the dry body
+	Creature& creature = run.creature;
+	vector<PartBounds>& bounds = run.bounds;
+	
+	NxMat34 pose;
+	pose.id();
+	EdgeMarks marks(genes);
+	BodyPart* root = screenRec(genes, marks, &creature, genes.root, pose, 1., -1, bounds, run.effectors, opts);
+	
+	res.num_parts = creature.body.size();
+	res.num_joints = run.effectors.size();
+	
+	if(root == NULL)
+	{
+		res.reason = "too many body parts";
+		return false;
+	}
+	creature.root = root;
+	
+	if(res.num_parts <= 1)
+	{
+		res.reason = "single body part";
+		return false;
+	}
+	
+	//Estimate self intersection between parts which aren't attached
+	int pairs = 0, hits = 0;
+	for(int i=0; i<(int)bounds.size(); i++)
+	for(int j=i+1; j<(int)bounds.size(); j++)
+	{
+		if(bounds[j].parent == i || bounds[i].parent == j)
+			continue;
+		pairs++;
+		float d = (bounds[i].center - bounds[j].center).magnitude();
+		if(d < 0.5 * (bounds[i].radius + bounds[j].radius))
+			hits++;
+	}
+	if(pairs > 0)
+		res.overlap = (float)hits / (float)pairs;
+	
+	//BatchCircuit has no settle passes, so neither do single dry runs
+	creature.compile();
+	creature.circuit->settle(0);
+	return true;
+}
+
+//Scores the effector signals recorded by the dry run
+static void finish_dry_run(DryRun& run)
+{
+	ScreenResult& res = run.res;
+	for(int i=0; i<(int)run.effectors.size(); i++)
+	{
+		if(!run.effectors[i]->finite)
+		{
+			res.reason = "non-finite effector signal";
+			return;
+		}
+		res.activity += run.effectors[i]->swing();
+	}
+	
+	if(!(res.activity > 0.))
+	{
+		res.reason = "effectors never move";
+		return;
+	}
+	
+	res.viable = true;
+	res.score = log(1. + res.activity) * res.num_joints * (1. - res.overlap);
+}
+
+ScreenResult prescreen(const Genotype& genes, const ScreenOptions& opts)
+{
+	DryRun run;
+	if(build_dry_run(genes, opts, run))
+	{
+		//Dry run the controller
+		for(int t=0; t<opts.ticks; t++)
+			run.creature.update();
+		finish_dry_run(run);
+	}
+	return run.res;
+}
+
+void prescreen(
+	const vector<const Genotype*>&	genes,
+	vector<ScreenResult>&			results,
+	const ScreenOptions&			opts)
+{
+	vector<DryRun*> runs(genes.size(), (DryRun*)NULL);
+	vector<int> ready;
+	vector<CompiledCircuit*> circuits;
+	for(int i=0; i<(int)genes.size(); i++)
+	{
+		runs[i] = new DryRun();
+		if(build_dry_run(*genes[i], opts, *runs[i]))
+		{
+			ready.push_back(i);
+			circuits.push_back(runs[i]->creature.circuit);
+		}
+	}
+	
+	//Dry run the controllers, siblings with the same wiring in lock-step
+	vector< vector<int> > groups;
+	group_circuits(circuits, groups);
+	for(int g=0; g<(int)groups.size(); g++)
+	{
+		const vector<int>& group = groups[g];
+		if(group.size() == 1)
+		{
+			Creature& creature = runs[ready[group[0]]]->creature;
+			for(int t=0; t<opts.ticks; t++)
+				creature.update();
+			continue;
+		}
+		
+		vector<CompiledCircuit*> lanes;
+		for(int i=0; i<(int)group.size(); i++)
+			lanes.push_back(circuits[group[i]]);
+		
+		BatchCircuit batch(lanes, opts.approx);
+		for(int t=0; t<opts.ticks; t++)
+			batch.update();
+		batch.store();
+	}
+	
+	results.resize(genes.size());
+	for(int i=0; i<(int)runs.size(); i++)
+	{
+		if(runs[i]->creature.circuit != NULL)
+			finish_dry_run(*runs[i]);
+		results[i] = runs[i]->res;
+		delete runs[i];
+	}
+}
+
+};
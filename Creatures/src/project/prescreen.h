@@ -0,0 +1,51 @@
+#ifndef PRESCREEN_H
+#define PRESCREEN_H
+
+#include "project/genotype.h"
+
+namespace Game
+{
+
+//Tuning knobs for the pre-screen
+struct ScreenOptions
+{
+	int		ticks;			//Length of the circuit dry run
+	int		max_parts;		//Creatures bigger than this are rejected outright
+	bool	batch;			//Dry run compatible circuits in lock-step, see batch_circuit.h
+	bool	approx;			//Use the fast_math kernels in batched dry runs
+	
+	ScreenOptions() : ticks(200), max_parts(64), batch(true), approx(false) {}
+};
+
+//Result of screening a genotype
+struct ScreenResult
+{
+	bool		viable;			//False if a full trial can't score anything
+	const char*	reason;			//Why the genotype was rejected
+	
+	int			num_parts;
+	int			num_joints;
+	float		activity;		//Total swing of the effector signals in the dry run
+	float		overlap;		//Fraction of non-adjacent part pairs which intersect
+	float		score;			//Rough rank, higher is more promising
+};
+
+//Cheaply checks a genotype before running any physics.  This builds the body
+//graph the same way createCreature does, but without actors or joints, then
+//dry runs the control circuit with synthetic sensor input.  Genotypes which
+//have at most one body part, no effector input that ever changes, or effector
+//signals which blow up to inf/nan are rejected.
+ScreenResult prescreen(const Genotype& genes, const ScreenOptions& opts = ScreenOptions());
+
+//Screens a whole generation at once.  Circuits with the same wiring are dry
+//run together through a BatchCircuit, which gives the same results as
+//screening them one by one unless opts.approx is set.
+void prescreen(
+	const std::vector<const Genotype*>&	genes,
+	std::vector<ScreenResult>&			results,
+	const ScreenOptions&				opts = ScreenOptions());
+
+};
+
+#endif
+
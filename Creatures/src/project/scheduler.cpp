@@ -0,0 +1,142 @@
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "common/sys_includes.h"
+#include "common/timer.h"
+
+#include "project/scheduler.h"
+
+using namespace std;
+using namespace Common;
+
+namespace Game
+{
+
+//The display never shows more than this many snapshots a second
+const double PUBLISH_INTERVAL = 1. / 120.;
+
+Scheduler::Scheduler(Population* population_, NxScene* scene_, float time_step_, float rate_) :
+	population(population_),
+	scene(scene_),
+	time_step(time_step_),
+	ticks(0),
+	rate(rate_),
+	paused(false),
+	measured(0.),
+	back(&buffers[0]),
+	front(&buffers[1]),
+	read(&buffers[2]),
+	fresh(false),
+	quit(false)
+{
+	pthread_mutex_init(&lock, NULL);
+	if(pthread_create(&thread, NULL, sim_main, this) != 0)
+	{
+		cout << "Failed to start simulation thread" << endl;
+		quit = true;
+	}
+}
+
+Scheduler::~Scheduler()
+{
+	if(!quit)
+	{
+		quit = true;
+		pthread_join(thread, NULL);
+	}
+	pthread_mutex_destroy(&lock);
+}
+
+const Snapshot& Scheduler::snapshot()
+{
+	pthread_mutex_lock(&lock);
+	if(fresh)
+	{
+		swap(read, front);
+		fresh = false;
+	}
+	pthread_mutex_unlock(&lock);
+	return *read;
+}
+
+void* Scheduler::sim_main(void* data)
+{
+	((Scheduler*)data)->run_sim();
+	return NULL;
+}
+
+//Same order as the old main loop: update the trial, then step the scene.
+//A tick which falls far behind its time is let go instead of caught up.
+void Scheduler::run_sim()
+{
+	double next_tick = wall_time(), next_publish = next_tick;
+	double count_start = next_tick;
+	long count_ticks = 0;
+
+	while(!quit)
+	{
+		if(paused)
+		{
+			usleep(10000);
+			next_tick = wall_time();
+			continue;
+		}
+
+		population->update();
+		scene->simulate(time_step);
+		scene->flushStream();
+		scene->fetchResults(NX_RIGID_BODY_FINISHED, true);
+		ticks++;
+
+		double now = wall_time();
+		if(now >= next_publish)
+		{
+			publish();
+			next_publish = now + PUBLISH_INTERVAL;
+		}
+
+		if(now - count_start >= 1.)
+		{
+			measured = (ticks - count_ticks) / (now - count_start);
+			count_start = now;
+			count_ticks = ticks;
+		}
+
+		float r = rate;
+		if(r <= 0.)
+			continue;
+
+		next_tick += 1. / r;
+		double wait = next_tick - now;
+		if(wait > 0.)
+			usleep((useconds_t)(wait * 1e6));
+		else if(wait < -0.25)
+			next_tick = now;
+	}
+}
+
+void Scheduler::publish()
+{
+	Creature* c = population->tester->creature;
+
+	back->parts.clear();
+	back->has_creature = c != NULL;
+	back->tick = ticks;
+	back->generation = population->generation;
+	if(c != NULL)
+	{
+		for(int i=0; i<(int)c->body.size(); i++)
+			back->parts.push_back(c->body[i]->snapshot());
+		back->focus = c->get_pose().t;
+	}
+
+	pthread_mutex_lock(&lock);
+	swap(back, front);
+	fresh = true;
+	pthread_mutex_unlock(&lock);
+}
+
+};
@@ -0,0 +1,91 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <vector>
+#include <pthread.h>
+
+#include "common/sys_includes.h"
+
+#include "project/creature.h"
+#include "project/population.h"
+
+namespace Game
+{
+
+//Poses of the creature on trial after some tick, for drawing
+struct Snapshot
+{
+	vector<PartSnapshot>	parts;
+	bool					has_creature;
+	NxVec3					focus;		//Position of the root part
+	long					tick;
+	int						generation;
+
+	Snapshot() : has_creature(false), focus(0., 0., 0.), tick(0), generation(0) {}
+};
+
+//Runs the interactive simulation on a thread of its own.
+//
+//	Every tick updates the population's current trial and steps the scene
+//	by time_step.  Ticks are paced to rate per second of wall time, or run
+//	as fast as they go if rate is 0.  Now and then the poses of the creature
+//	on trial are copied into a snapshot, which the drawing thread picks up
+//	without ever waiting on a tick.  Nothing but the scheduler may touch the
+//	population or the scene while it is running.
+struct Scheduler
+{
+	Scheduler(Population* population, NxScene* scene, float time_step, float rate);
+
+	//Stops the thread after the tick in progress
+	~Scheduler();
+
+	//Ticks per second, 0 for flat out.  May be called from any thread.
+	void set_rate(float r) { rate = r; }
+	float get_rate() const { return rate; }
+
+	void set_paused(bool p) { paused = p; }
+	bool is_paused() const { return paused; }
+
+	//Ticks run per second of wall time, measured over the last second
+	float measured_rate() const { return measured; }
+
+	//Newest snapshot.  Only for the drawing thread, the reference stays
+	//good until the next call.
+	const Snapshot& snapshot();
+
+private:
+	static void* sim_main(void* data);
+	void run_sim();
+
+	//Copies the poses into back and swaps it with front
+	void publish();
+
+	Population*			population;
+	NxScene*			scene;
+	float				time_step;
+	long				ticks;
+
+	volatile float		rate;
+	volatile bool		paused;
+	volatile float		measured;
+
+	//The simulation fills back, the drawing thread reads from read, front
+	//is the newest complete snapshot.  Only the swaps are under lock.
+	Snapshot			buffers[3];
+	Snapshot*			back;
+	Snapshot*			front;
+	Snapshot*			read;
+	bool				fresh;
+
+	pthread_t			thread;
+	pthread_mutex_t		lock;
+	volatile bool		quit;
+
+	//Not copyable
+	Scheduler(const Scheduler&);
+	Scheduler& operator=(const Scheduler&);
+};
+
+};
+
+#endif
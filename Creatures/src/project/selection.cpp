@@ -0,0 +1,161 @@
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <utility>
+#include <cstdlib>
+
+#include "project/selection.h"
+
+using namespace std;
+using Common::Random;
+
+namespace Game
+{
+
+//Uniform integer in [0,n)
+static int rand_index(Random& rng, int n)
+{
+	int r = rng.below(n);
+	return r < n ? r : n - 1;
+}
+
+void RouletteSelector::prepare(const vector<float>& fitness)
+{
+	prefix.resize(fitness.size());
+	double s = 0.;
+	for(int i=0; i<(int)fitness.size(); i++)
+	{
+		s += max(fitness[i], 0.f);
+		prefix[i] = s;
+	}
+}
+
+int RouletteSelector::select(Random& rng)
+{
+	int n = prefix.size();
+	if(prefix[n-1] <= 0.)
+		return rand_index(rng, n);
+
+	//First species whose running sum reaches r, same as the old linear scan
+	double r = rng.uniform() * prefix[n-1];
+	int i = lower_bound(prefix.begin(), prefix.end(), r) - prefix.begin();
+	return min(i, n-1);
+}
+
+void AliasSelector::prepare(const vector<float>& fitness)
+{
+	vector<double> w(fitness.size());
+	for(int i=0; i<(int)fitness.size(); i++)
+		w[i] = max(fitness[i], 0.f);
+	build(w);
+}
+
+void AliasSelector::build(const vector<double>& weights)
+{
+	int n = weights.size();
+	prob.resize(n);
+	alias.resize(n);
+
+	double s = 0.;
+	for(int i=0; i<n; i++)
+		s += weights[i];
+
+	//Scale so the average bucket is 1, then pair each short bucket with a
+	//long one which tops it up
+	vector<int> small, large;
+	for(int i=0; i<n; i++)
+	{
+		prob[i] = s > 0. ? weights[i] * n / s : 1.;
+		alias[i] = i;
+		if(prob[i] < 1.)
+			small.push_back(i);
+		else
+			large.push_back(i);
+	}
+
+	while(small.size() > 0 && large.size() > 0)
+	{
+		int l = small.back(), g = large.back();
+		small.pop_back();
+
+		alias[l] = g;
+		prob[g] -= 1. - prob[l];
+		if(prob[g] < 1.)
+		{
+			large.pop_back();
+			small.push_back(g);
+		}
+	}
+
+	//Whatever is left over is only off by rounding
+	for(int i=0; i<(int)small.size(); i++)
+		prob[small[i]] = 1.;
+	for(int i=0; i<(int)large.size(); i++)
+		prob[large[i]] = 1.;
+}
+
+int AliasSelector::select(Random& rng)
+{
+	int n = prob.size();
+	double r = rng.uniform() * n;
+	int i = min((int)r, n-1);
+	return (r - i) < prob[i] ? i : alias[i];
+}
+
+void TournamentSelector::prepare(const vector<float>& fitness)
+{
+	scores = fitness;
+}
+
+int TournamentSelector::select(Random& rng)
+{
+	int n = scores.size();
+	int best = rand_index(rng, n);
+	for(int i=1; i<size; i++)
+	{
+		int c = rand_index(rng, n);
+		if(scores[c] > scores[best])
+			best = c;
+	}
+	return best;
+}
+
+void RankSelector::prepare(const vector<float>& fitness)
+{
+	int n = fitness.size();
+
+	vector< pair<float,int> > ranked(n);
+	for(int i=0; i<n; i++)
+		ranked[i] = make_pair(fitness[i], i);
+	sort(ranked.begin(), ranked.end());
+
+	order.resize(n);
+	vector<double> w(n);
+	for(int i=0; i<n; i++)
+	{
+		order[i] = ranked[i].second;
+		w[i] = n > 1 ? (2. - pressure) + 2. * (pressure - 1.) * i / (n - 1) : 1.;
+	}
+	table.build(w);
+}
+
+int RankSelector::select(Random& rng)
+{
+	return order[table.select(rng)];
+}
+
+Selector* createSelector(const string& name)
+{
+	if(name == "roulette")
+		return new RouletteSelector();
+	if(name == "alias")
+		return new AliasSelector();
+	if(name == "tournament")
+		return new TournamentSelector();
+	if(name == "rank")
+		return new RankSelector();
+	return NULL;
+}
+
+};
+
@@ -0,0 +1,92 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include <vector>
+#include <string>
+
+#include "common/random.h"
+
+namespace Game
+{
+
+//Picks parents for the next generation
+//
+//	prepare() is called once per generation with the scores, then select()
+//	is called once per child.  Negative scores count as zero.  A selector
+//	keeps no random state of its own, every draw comes from rng.
+struct Selector
+{
+	virtual ~Selector() {}
+
+	virtual void prepare(const std::vector<float>& fitness) = 0;
+	virtual int select(Common::Random& rng) = 0;
+
+	virtual const char* name() const = 0;
+};
+
+//Fitness proportional, binary search over the running sum.  O(n) to prepare,
+//O(log n) per pick.
+struct RouletteSelector : public Selector
+{
+	virtual void prepare(const std::vector<float>& fitness);
+	virtual int select(Common::Random& rng);
+	virtual const char* name() const { return "roulette"; }
+
+private:
+	std::vector<double>	prefix;
+};
+
+//Fitness proportional, Vose's alias method.  O(n) to prepare, O(1) per pick.
+struct AliasSelector : public Selector
+{
+	virtual void prepare(const std::vector<float>& fitness);
+	virtual int select(Common::Random& rng);
+	virtual const char* name() const { return "alias"; }
+
+	//Same as prepare, but with arbitrary non-negative weights
+	void build(const std::vector<double>& weights);
+
+private:
+	std::vector<double>	prob;
+	std::vector<int>	alias;
+};
+
+//Best of size uniformly drawn species.  Nothing to prepare, O(size) per pick.
+struct TournamentSelector : public Selector
+{
+	TournamentSelector(int size_ = 3) : size(size_) {}
+
+	virtual void prepare(const std::vector<float>& fitness);
+	virtual int select(Common::Random& rng);
+	virtual const char* name() const { return "tournament"; }
+
+	int		size;
+
+private:
+	std::vector<float>	scores;
+};
+
+//Linear ranking.  The best species is picked pressure times as often as the
+//average one, pressure must be in [1,2].  O(n log n) to prepare, O(1) per pick.
+struct RankSelector : public Selector
+{
+	RankSelector(float pressure_ = 1.5) : pressure(pressure_) {}
+
+	virtual void prepare(const std::vector<float>& fitness);
+	virtual int select(Common::Random& rng);
+	virtual const char* name() const { return "rank"; }
+
+	float	pressure;
+
+private:
+	std::vector<int>	order;
+	AliasSelector		table;
+};
+
+//Creates a selector by name, returns NULL if there is no such policy
+Selector* createSelector(const std::string& name);
+
+};
+
+#endif
+
@@ -0,0 +1,218 @@
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "project/telemetry.h"
+
+using namespace std;
+using namespace Common;
+
+namespace Game
+{
+
+const float PERCENTILES[NUM_PERCENTILES] = { 0., 10., 25., 50., 75., 90., 100. };
+
+//Bucket counts as one field, separated by spaces
+static void print_histogram(FILE* f, const long* buckets)
+{
+	for(int i=0; i<FAN_BUCKETS; i++)
+		fprintf(f, i ? " %ld" : "%ld", buckets[i]);
+}
+
+//Opens a log for writing or appending.  Sets fresh if it starts out empty
+//and needs its header line.
+static FILE* open_log(const string& path, bool append, bool& fresh)
+{
+	FILE* f = fopen(path.c_str(), append ? "a" : "w");
+	fresh = f != NULL && (fseek(f, 0, SEEK_END) != 0 || ftell(f) == 0);
+	return f;
+}
+
+Telemetry::Telemetry(
+	const string& dir,
+	int num_producers,
+	bool append,
+	bool circuits_,
+	int capacity) :
+	generation_queue(capacity),
+	generation_drops(0),
+	circuits(circuits_),
+	circuit_file(NULL),
+	quit(false)
+{
+	for(int i=0; i<num_producers; i++)
+	{
+		trial_queues.push_back(new RingBuffer<TrialRecord>(capacity));
+		trial_drops.push_back(0);
+	}
+
+	bool trial_fresh, generation_fresh, circuit_fresh = false;
+	trial_file = open_log(dir + "/trials.csv", append, trial_fresh);
+	generation_file = open_log(dir + "/generations.csv", append, generation_fresh);
+	if(circuits)
+		circuit_file = open_log(dir + "/circuits.csv", append, circuit_fresh);
+
+	if(trial_fresh)
+		fprintf(trial_file,
+			"generation,species,fitness,ticks,stopped,"
+			"build_time,circuit_time,physics_time,total_time,"
+			"actors,joints,contacts,"
+			"gates,wires,gate_evals,gate_time,fan_in,fan_out\n");
+
+	if(generation_fresh)
+	{
+		fprintf(generation_file,
+			"generation,species,trials,cached,rejected,"
+			"screen_time,evaluate_time,breed_time,build_time,"
+			"actors_created,actors_reused,skeletons_cooked,skeletons_reused,"
+			"build_saved,circuit_size,pruned");
+		for(int i=0; i<NUM_PERCENTILES; i++)
+			fprintf(generation_file, ",p%d", (int)PERCENTILES[i]);
+		fprintf(generation_file, ",best\n");
+	}
+	
+	//Times are seconds summed over the generation, the fan columns count
+	//gates per bucket of fanBucket()
+	if(circuit_fresh)
+	{
+		fprintf(circuit_file, "generation,circuits,gates,wires,ticks");
+		for(int i=0; i<NUM_GATE_OPS; i++)
+			fprintf(circuit_file, ",%s_evals,%s_time", opName(i), opName(i));
+		for(int i=0; i<FAN_BUCKETS; i++)
+			fprintf(circuit_file, ",fan_in%d", i);
+		for(int i=0; i<FAN_BUCKETS; i++)
+			fprintf(circuit_file, ",fan_out%d", i);
+		fprintf(circuit_file, "\n");
+	}
+
+	if(pthread_create(&thread, NULL, writer_main, this) != 0)
+	{
+		printf("Failed to start telemetry thread\n");
+		quit = true;
+	}
+}
+
+Telemetry::~Telemetry()
+{
+	if(!quit)
+	{
+		quit = true;
+		pthread_join(thread, NULL);
+	}
+	drain();
+
+	if(trial_file != NULL)
+		fclose(trial_file);
+	if(generation_file != NULL)
+		fclose(generation_file);
+	if(circuit_file != NULL)
+		fclose(circuit_file);
+	for(int i=0; i<(int)trial_queues.size(); i++)
+		delete trial_queues[i];
+}
+
+void Telemetry::trial(int producer, const TrialRecord& record)
+{
+	if(!trial_queues[producer]->push(record))
+		trial_drops[producer]++;
+}
+
+void Telemetry::generation(const GenerationRecord& record)
+{
+	if(!generation_queue.push(record))
+		generation_drops++;
+}
+
+int Telemetry::dropped() const
+{
+	int n = generation_drops;
+	for(int i=0; i<(int)trial_drops.size(); i++)
+		n += trial_drops[i];
+	return n;
+}
+
+void* Telemetry::writer_main(void* data)
+{
+	((Telemetry*)data)->run_writer();
+	return NULL;
+}
+
+//Polls the queues, a generation takes far longer than the nap
+void Telemetry::run_writer()
+{
+	while(!quit)
+	{
+		if(drain() == 0)
+			usleep(10000);
+	}
+}
+
+int Telemetry::drain()
+{
+	int n = 0;
+
+	TrialRecord t;
+	for(int i=0; i<(int)trial_queues.size(); i++)
+	{
+		while(trial_queues[i]->pop(t))
+		{
+			n++;
+			if(trial_file == NULL)
+				continue;
+			const CircuitProfile& c = t.circuit;
+			fprintf(trial_file, "%d,%d,%g,%d,%d,%.6f,%.6f,%.6f,%.6f,%d,%d,%d,%ld,%ld,%ld,%.6f,",
+				t.generation, t.species, t.fitness, t.ticks, (int)t.stopped,
+				t.build_time, t.circuit_time, t.physics_time, t.total_time,
+				t.actors, t.joints, t.contacts,
+				c.gates, c.wires, c.total_evals(), c.total_seconds());
+			print_histogram(trial_file, c.fan_in);
+			fprintf(trial_file, ",");
+			print_histogram(trial_file, c.fan_out);
+			fprintf(trial_file, "\n");
+		}
+	}
+
+	GenerationRecord g;
+	while(generation_queue.pop(g))
+	{
+		n++;
+		if(generation_file == NULL)
+			continue;
+		fprintf(generation_file, "%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%d,%d,%d,%d,%.6f,%g,%d",
+			g.generation, g.species, g.trials, g.cached, g.rejected,
+			g.screen_time, g.evaluate_time, g.breed_time, g.build_time,
+			g.actors_created, g.actors_reused, g.skeletons_cooked, g.skeletons_reused,
+			g.build_saved, g.circuit_size, g.pruned);
+		for(int i=0; i<NUM_PERCENTILES; i++)
+			fprintf(generation_file, ",%g", g.fitness[i]);
+		fprintf(generation_file, ",%g\n", g.best);
+		
+		if(circuit_file == NULL)
+			continue;
+		const CircuitProfile& c = g.circuits;
+		fprintf(circuit_file, "%d,%ld,%ld,%ld,%ld", g.generation, c.circuits, c.gates, c.wires, c.ticks);
+		for(int i=0; i<NUM_GATE_OPS; i++)
+			fprintf(circuit_file, ",%ld,%.6f", c.evals[i], c.seconds(i));
+		for(int i=0; i<FAN_BUCKETS; i++)
+			fprintf(circuit_file, ",%ld", c.fan_in[i]);
+		for(int i=0; i<FAN_BUCKETS; i++)
+			fprintf(circuit_file, ",%ld", c.fan_out[i]);
+		fprintf(circuit_file, "\n");
+	}
+
+	//Flushed as it goes, so the files can be followed during a run
+	if(n > 0)
+	{
+		if(trial_file != NULL)
+			fflush(trial_file);
+		if(generation_file != NULL)
+			fflush(generation_file);
+		if(circuit_file != NULL)
+			fflush(circuit_file);
+	}
+	return n;
+}
+
+};
@@ -0,0 +1,136 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <pthread.h>
+
+#include "common/ring_buffer.h"
+
+#include "project/circuit.h"
+
+namespace Game
+{
+
+//Where the time of one trial went, in seconds
+struct TrialRecord
+{
+	int		generation;
+	int		species;
+	float	fitness;
+	int		ticks;
+	bool	stopped;		//Cut short by a stop rule
+
+	double	build_time;		//Building the creature from its genes
+	double	circuit_time;	//Fitness test updates: circuits, sensors and scoring
+	double	physics_time;	//Stepping the scene
+	double	total_time;
+
+	//Peak counts over the trial, sampled every few ticks
+	int		actors, joints, contacts;
+	
+	//Gate counts and timings of the creature's circuit, if profiled
+	CircuitProfile	circuit;
+};
+
+//Fitness percentiles kept per generation
+const int NUM_PERCENTILES = 7;
+extern const float PERCENTILES[NUM_PERCENTILES];	//0, 10, 25, 50, 75, 90, 100
+
+//Where the time of one generation went, in seconds
+struct GenerationRecord
+{
+	int		generation;
+	int		species;
+	int		trials;			//Given a full trial
+	int		cached;			//Scored from the fitness cache or a duplicate
+	int		rejected;		//Turned away by the pre-screen
+
+	double	screen_time;
+	double	evaluate_time;
+	double	breed_time;		//Selection and mutation, without the next screen
+	
+	double	build_time;		//Building creatures, summed over the trials
+	int		actors_created, actors_reused;
+	int		skeletons_cooked, skeletons_reused;
+	double	build_saved;	//Estimated build time the reused objects saved
+	
+	float	circuit_size;	//Mean gates and wires per genotype
+	int		pruned;			//Genes Genotype::prune() took out of the children
+
+	float	fitness[NUM_PERCENTILES];
+	float	best;			//Best ever
+	
+	//Circuits of every trial in the generation, if profiled
+	CircuitProfile	circuits;
+};
+
+//Structured run log.
+//
+//	Records go into lock-free ring buffers, one per producing thread, and a
+//	background thread drains them into <dir>/trials.csv and
+//	<dir>/generations.csv.  Producers never wait, if the writer falls behind
+//	the record is dropped and counted instead.  Trial producers are numbered
+//	from 0, generation records come from a single thread of their own.
+//
+//	With append set the files of an earlier run are added to instead of
+//	replaced, e.g. when it is resumed.  With circuits set, the circuit
+//	profile of every generation also goes into <dir>/circuits.csv, broken
+//	down by gate type.
+class Telemetry
+{
+public:
+	Telemetry(
+		const std::string& dir,
+		int num_producers,
+		bool append = false,
+		bool circuits = false,
+		int capacity = 1024);
+
+	//Writes whatever is still queued
+	~Telemetry();
+
+	//False if the files couldn't be opened, records are then thrown away
+	bool ok() const
+	{
+		return trial_file != NULL && generation_file != NULL &&
+			(!circuits || circuit_file != NULL);
+	}
+
+	void trial(int producer, const TrialRecord& record);
+	void generation(const GenerationRecord& record);
+
+	//Number of records lost to full buffers
+	int dropped() const;
+
+	int num_producers() const { return trial_queues.size(); }
+
+private:
+	static void* writer_main(void* data);
+	void run_writer();
+
+	//Empties every queue, returns the number of records written
+	int drain();
+
+	std::vector< Common::RingBuffer<TrialRecord>* >	trial_queues;
+	std::vector<int>								trial_drops;
+	Common::RingBuffer<GenerationRecord>			generation_queue;
+	int												generation_drops;
+
+	bool				circuits;
+	FILE*				trial_file;
+	FILE*				generation_file;
+	FILE*				circuit_file;
+
+	pthread_t			thread;
+	volatile bool		quit;
+
+	//Not copyable
+	Telemetry(const Telemetry&);
+	Telemetry& operator=(const Telemetry&);
+};
+
+};
+
+#endif